@@ -0,0 +1,461 @@
+/*
+ * nxp_simtemp.h - NXP Simulated Temperature Sensor Driver (internal)
+ *
+ * Definitions shared between the driver translation units.
+ */
+
+#ifndef _NXP_SIMTEMP_H
+#define _NXP_SIMTEMP_H
+
+#include <linux/types.h>
+#include <linux/platform_device.h>
+#include <linux/miscdevice.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/dcache.h>
+#include <linux/atomic.h>
+#include <linux/sched.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/mutex.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
+#include <linux/kref.h>
+#include <linux/kfifo.h>
+#include <linux/random.h>
+
+#include "nxp_simtemp_ioctl.h"
+#include "nxp_simtemp_core.h"
+
+struct iio_dev;
+struct rchan;
+struct thermal_zone_device;
+
+#define DRIVER_NAME "nxp_simtemp"
+#define DEVICE_NAME "simtemp"
+
+/* Sample periods each ring holds (must be power of 2 for efficiency) */
+#define RING_BUFFER_SIZE 64
+
+/* Adaptive sampling divides the rate by at most 2^SIMTEMP_RATE_SHIFT_MAX */
+#define SIMTEMP_RATE_SHIFT_MAX  4
+
+/* Channel array limits (DT "num-channels", sysfs "channels") */
+#define SIMTEMP_MAX_CHANNELS    4096
+#define SIMTEMP_SHARD_CHANNELS  256     /* Channels per generation shard */
+
+/*
+ * Log2 latency histogram
+ *
+ * Bucket 0 counts zero values, bucket i (i > 0) counts values in
+ * [2^(i-1), 2^i). Every CPU owns its own copy so the hot path never
+ * takes a lock or bounces a cache line; readers sum all CPUs.
+ */
+#define SIMTEMP_HIST_BUCKETS 64
+
+struct simtemp_hist_cpu {
+    u64 count[SIMTEMP_HIST_BUCKETS];
+    u64 sum;
+    u64 max;
+};
+
+struct simtemp_hist {
+    struct simtemp_hist_cpu __percpu *pcpu;
+    const char *unit;
+};
+
+/* Generator timing statistics (debugfs) */
+struct simtemp_stats {
+    struct simtemp_hist timer_lateness;    /* ns past programmed expiry */
+    struct simtemp_hist callback_duration; /* ns spent in the callback */
+    struct simtemp_hist ring_occupancy;    /* samples queued at wakeup */
+    struct simtemp_hist delivery_latency;  /* ns from generation to read */
+    struct dentry *debugfs_dir;
+    struct dentry *readers_dir;
+    atomic_t reader_ids;
+};
+
+/* Execution context of the sample generator */
+enum simtemp_gen_mode {
+    SIMTEMP_GEN_HARDIRQ,    /* hrtimer expiring in hard-IRQ context */
+    SIMTEMP_GEN_SOFTIRQ,    /* hrtimer expiring in softirq context */
+    SIMTEMP_GEN_THREAD,     /* SCHED_FIFO kthread sleeping on an hrtimer */
+};
+
+/* Where sample values come from */
+enum simtemp_source {
+    SIMTEMP_SRC_RANDOM,     /* Uniform noise around base_temp_mC */
+    SIMTEMP_SRC_REPLAY,     /* Firmware trace, then write() records */
+};
+
+/* Signal shape of generated values (nxp_simtemp_wave.c) */
+enum simtemp_profile {
+    SIMTEMP_PROFILE_NOISE,      /* Uniform noise around base_temp_mC */
+    SIMTEMP_PROFILE_SINE,
+    SIMTEMP_PROFILE_RAMP,       /* Sawtooth */
+    SIMTEMP_PROFILE_STEP,       /* Square wave */
+    SIMTEMP_PROFILE_WALK,       /* Random walk, repeating */
+    SIMTEMP_PROFILE_THERMAL,    /* First-order heating and cooling */
+    SIMTEMP_PROFILE_NR,
+};
+
+struct simtemp_wave {
+    enum simtemp_profile profile;
+    u32 period_ms;              /* One waveform cycle */
+    u32 noise_mC;               /* Uniform noise on top, 0 = none */
+    u32 phase_inc;              /* Phase advance per sampling period */
+    s32 table[SIMTEMP_WAVE_SIZE];   /* Shape scaled to temp_variation_mC */
+};
+
+/* Thermal zone state (nxp_simtemp_thermal.c) */
+struct simtemp_thermal {
+    struct thermal_zone_device *tz;
+    struct work_struct work;    /* Runs thermal_zone_device_update() */
+    s32 temp_mC;                /* Channel 0 of the latest period */
+    bool valid;                 /* temp_mC holds a sample */
+    bool above;                 /* Last period exceeded the threshold */
+    bool enabled;               /* Zone mode holds a session (gen_lock) */
+};
+
+/* Netlink event record and queue (nxp_simtemp_genl.c) */
+struct simtemp_event {
+    u32 type;                   /* enum simtemp_genl_event_type */
+    u32 pid;                    /* Overflowing reader */
+    s32 threshold_mC;
+    u64 timestamp_ns;
+    u64 lost;                   /* Samples lost by the reader */
+};
+
+struct simtemp_events {
+    spinlock_t lock;            /* Serializes producers and the work */
+    DECLARE_KFIFO(fifo, struct simtemp_event, 32);
+    struct work_struct work;    /* Multicasts the queued events */
+};
+
+/* Bulk capture channel (nxp_simtemp_relay.c) */
+struct simtemp_relay {
+    struct rchan __rcu *chan;   /* NULL while capture is disabled */
+    struct dentry *dir;
+    u32 subbuf_size;            /* Sub-buffer geometry of the next channel */
+    u32 n_subbufs;
+    u32 format;                 /* SIMTEMP_FORMAT_V2 or _DELTA, next channel */
+    bool enabled;               /* Channel holds a session (gen_lock) */
+};
+
+/* Replay source state (nxp_simtemp_replay.c) */
+struct simtemp_replay {
+    struct task_struct *thread;
+    struct simtemp_sample *trace;       /* Copy of the firmware trace */
+    u32 trace_len;
+    char fw_name[64];
+    u32 speed;                          /* Time divisor, 0 = no delays */
+    DECLARE_KFIFO_PTR(fifo, struct simtemp_sample);    /* write() queue */
+    struct mutex write_lock;            /* Serializes fifo producers */
+    wait_queue_head_t wait;             /* Fifo not empty / not full */
+    s32 temp_mC;                        /* Value of the sample in flight */
+};
+
+/* Min-heap of the hottest channels, the coolest of them at v[0] */
+struct simtemp_topk_heap {
+    u32 nr;
+    struct simtemp_channel_value v[SIMTEMP_TOPK_MAX];
+};
+
+/*
+ * A contiguous slice of the channel array. Each shard is generated by
+ * its own work item on its own CPU and stored in its own ring segment,
+ * so large channel sets scale with the number of CPUs.
+ */
+struct simtemp_shard {
+    struct simtemp_device *dev;
+    u32 first_channel;
+    u32 nr_channels;
+    int cpu;                    /* Where the work item is queued */
+    struct work_struct work;
+
+    struct simtemp_ring_buffer ring;
+    struct simtemp_sample_v2 *samples;  /* Ring storage */
+    struct simtemp_sample_v2 *periods;  /* Two periods, by seq parity */
+    struct simtemp_topk_heap topk[2];   /* Hottest channels, same parity */
+    u64 put_head;               /* Ring head after the last put */
+    u32 flags_seen;             /* Flags of the last period, OR-ed */
+    u64 published;              /* Ring head readers may consume up to */
+    u64 stream_start;           /* Ring seq where the session began */
+};
+
+/* Device private data */
+struct simtemp_device {
+    struct platform_device *pdev;
+    struct miscdevice mdev;
+    int id;                     /* Instance number */
+    char name[16];              /* simtemp, simtemp1, ... */
+    struct kref ref;            /* Probe plus one per open file */
+    bool dead;                  /* Removed, open files get -ENODEV */
+    u32 sampling_ms;
+    s32 threshold_mC;
+    s32 base_temp_mC;
+    u32 temp_variation_mC;
+    struct simtemp_wave wave;
+
+    /* Channel array, split into shards with a ring segment each */
+    u32 num_channels;
+    unsigned int nr_shards;
+    struct simtemp_shard *shards;
+    atomic_t shards_busy;       /* Shards still generating, plus one */
+    u64 tick_ns;                /* Timestamp of the period in progress */
+    u64 tick_seq;               /* Periods published (snapshot generation) */
+    u32 live_seq;               /* First period of the session after the pre-roll */
+    ktime_t start_expiry;       /* First tick of the next start, 0 = pick then */
+    u64 published_ns;           /* Timestamp of the last complete period */
+
+    /* Adaptive sampling: generate one period out of 2^rate_shift */
+    u32 adaptive_lag;           /* Periods every reader lags to slow down, 0 = off */
+    u32 rate_shift;
+    bool rate_changed;          /* Flag the next generated period */
+    u32 period_flags;           /* Extra flags of the period in progress */
+    bool exceeded;              /* Last period exceeded the threshold */
+
+    /* High-resolution timer for periodic sampling */
+    struct hrtimer timer;
+    ktime_t timer_interval;
+
+    /* Generation context, start/stop serialized by gen_lock */
+    struct mutex gen_lock;
+    enum simtemp_gen_mode gen_mode;
+    struct task_struct *gen_thread;
+    bool gen_running;
+    enum simtemp_source source;
+    struct simtemp_replay replay;
+    bool align;                 /* Fire on multiples of the period */
+    u32 slack_ns;               /* hrtimer range for expiry coalescing */
+    struct cpumask gen_cpus;    /* CPUs the timer or thread may run on */
+
+    /* Generation runs only while open files or IIO consume it (gen_lock) */
+    unsigned int open_count;
+    u32 preroll;                /* Periods back-filled on first open */
+
+    /* Wait queue for blocking reads and poll/select */
+    wait_queue_head_t wait_queue;
+
+    /* Timing histograms */
+    struct simtemp_stats stats;
+
+    /* IIO front end, NULL without CONFIG_IIO_TRIGGERED_BUFFER */
+    struct iio_dev *iio;
+
+    /* Thermal zone, tz is NULL without CONFIG_THERMAL */
+    struct simtemp_thermal thermal;
+
+    /* Netlink events, only queued while the group has listeners */
+    struct simtemp_events events;
+
+    /* Relay capture, chan is NULL without CONFIG_RELAY */
+    struct simtemp_relay relay;
+
+    /* Event counters (sysfs and SIMTEMP_IOC_GET_COUNTERS) */
+    struct simtemp_counters __percpu *counters;
+
+    /* Open files; writers hold readers_lock, the timer walks it under RCU */
+    struct list_head readers;
+    spinlock_t readers_lock;
+};
+
+/* Samples pulled from the ring per lock acquisition in read() */
+#define SIMTEMP_READ_BATCH 16
+
+/* Per open file state */
+struct simtemp_reader {
+    struct simtemp_device *dev;
+    struct list_head node;      /* On dev->readers */
+    struct rcu_head rcu;
+    pid_t pid;
+    char comm[TASK_COMM_LEN];
+
+    u64 overflows;              /* Samples lost to overwrites */
+
+    /* Delivery settings (SIMTEMP_IOC_SET_READER_CONFIG) */
+    u32 filter;                 /* Required flags, 0 = everything */
+    u32 decimation;             /* Deliver every Nth sample period */
+    u32 watermark;              /* Pending samples needed to wake up */
+    u32 format;                 /* SIMTEMP_FORMAT_* */
+    u32 clock;                  /* clockid of timestamp_ns (SIMTEMP_IOC_SET_CLOCK) */
+
+    /* Async notification, raised from the sampling path */
+    struct eventfd_ctx __rcu *eventfd;  /* SIMTEMP_IOC_SET_EVENTFD */
+    struct fasync_struct *fasync;       /* SIGIO */
+    bool notified;              /* Watermark reached and already signalled */
+
+    /* Generation to copy_to_user delay of samples read by this file */
+    struct simtemp_hist delivery_latency;
+    struct dentry *debugfs_file;
+
+    /* read() staging, kept off the stack and serialized by read_lock */
+    struct mutex read_lock;
+    struct simtemp_sample_v2 read_samples[SIMTEMP_READ_BATCH];
+    u8 read_delta[sizeof(struct simtemp_delta_batch) +
+                  SIMTEMP_READ_BATCH * SIMTEMP_DELTA_MAX_SAMPLE];
+
+    /* Ring position per shard, each protected by that shard's ring lock */
+    u64 cursors[];
+};
+
+/**
+ * simtemp_hist_record - Account one value in a histogram
+ * @hist: Histogram
+ * @val: Value to record
+ *
+ * Safe from any context: only this CPU's copy is touched, through
+ * this_cpu operations that are atomic with respect to interrupts.
+ */
+static inline void simtemp_hist_record(struct simtemp_hist *hist, u64 val)
+{
+    unsigned int bucket = min_t(unsigned int, fls64(val),
+                                SIMTEMP_HIST_BUCKETS - 1);
+
+    this_cpu_inc(hist->pcpu->count[bucket]);
+    this_cpu_add(hist->pcpu->sum, val);
+    if (val > this_cpu_read(hist->pcpu->max))
+        this_cpu_write(hist->pcpu->max, val);
+}
+
+/**
+ * simtemp_wave_value - Waveform value at a phase
+ * @wave: Device waveform
+ * @phase: Phase of the channel, 2^32 is one cycle
+ *
+ * Returns: offset from base_temp_mC in milli-degrees, noise included
+ */
+static inline s32 simtemp_wave_value(struct simtemp_wave *wave, u32 phase)
+{
+    s32 val = simtemp_core_wave(wave->table, phase);
+    u32 noise = READ_ONCE(wave->noise_mC);
+
+    if (noise)
+        val = simtemp_core_noise(val, noise, get_random_u32());
+
+    return val;
+}
+
+/* misc device sysfs attributes: drvdata is the miscdevice */
+static inline struct simtemp_device *simtemp_from_sysfs(struct device *d)
+{
+    struct miscdevice *mdev = dev_get_drvdata(d);
+
+    return container_of(mdev, struct simtemp_device, mdev);
+}
+
+/* nxp_simtemp_main.c */
+void simtemp_tick(struct simtemp_device *dev, ktime_t expires);
+int simtemp_gen_restart(struct simtemp_device *dev);
+int simtemp_session_get(struct simtemp_device *dev);
+void simtemp_session_put(struct simtemp_device *dev);
+int simtemp_set_sampling_ms(struct simtemp_device *dev, u32 ms);
+void __simtemp_set_threshold(struct simtemp_device *dev, s32 threshold_mC);
+void simtemp_set_threshold(struct simtemp_device *dev, s32 threshold_mC);
+size_t simtemp_samples_to_delta(const struct simtemp_sample_v2 *samples,
+                                unsigned int n, u8 *out);
+
+#if IS_ENABLED(CONFIG_KUNIT)
+/* Generator entry of nxp_simtemp_main.c, for nxp_simtemp_test.c */
+void simtemp_generate_sample(struct simtemp_device *dev,
+                             struct simtemp_sample_v2 *sample,
+                             u64 timestamp_ns, u64 wall_ns,
+                             u32 channel, u32 phase);
+#endif
+
+/* nxp_simtemp_replay.c */
+extern const struct attribute_group simtemp_replay_group;
+int simtemp_replay_init(struct simtemp_device *dev);
+void simtemp_replay_exit(struct simtemp_device *dev);
+int simtemp_replay_start(struct simtemp_device *dev);
+void simtemp_replay_stop(struct simtemp_device *dev);
+ssize_t simtemp_replay_write(struct file *filp, const char __user *buf,
+                             size_t count, loff_t *ppos);
+
+/* nxp_simtemp_wave.c */
+extern const char * const simtemp_profile_names[SIMTEMP_PROFILE_NR];
+extern const struct attribute_group simtemp_wave_group;
+void simtemp_wave_init(void);
+void simtemp_wave_update(struct simtemp_device *dev);
+
+/* nxp_simtemp_iio.c */
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+int simtemp_iio_init(struct simtemp_device *dev);
+void simtemp_iio_exit(struct simtemp_device *dev);
+void simtemp_iio_free(struct simtemp_device *dev);
+void simtemp_iio_push(struct simtemp_device *dev, s32 temp_mC);
+#else
+static inline int simtemp_iio_init(struct simtemp_device *dev) { return 0; }
+static inline void simtemp_iio_exit(struct simtemp_device *dev) { }
+static inline void simtemp_iio_free(struct simtemp_device *dev) { }
+static inline void simtemp_iio_push(struct simtemp_device *dev, s32 temp_mC) { }
+#endif
+
+/* nxp_simtemp_thermal.c */
+#if IS_ENABLED(CONFIG_THERMAL)
+int simtemp_thermal_init(struct simtemp_device *dev);
+void simtemp_thermal_exit(struct simtemp_device *dev);
+void simtemp_thermal_push(struct simtemp_device *dev, s32 temp_mC);
+void simtemp_thermal_sync_trip(struct simtemp_device *dev);
+#else
+static inline int simtemp_thermal_init(struct simtemp_device *dev) { return 0; }
+static inline void simtemp_thermal_exit(struct simtemp_device *dev) { }
+static inline void simtemp_thermal_push(struct simtemp_device *dev, s32 temp_mC) { }
+static inline void simtemp_thermal_sync_trip(struct simtemp_device *dev) { }
+#endif
+
+/* nxp_simtemp_genl.c */
+#if IS_ENABLED(CONFIG_NET)
+int simtemp_genl_register(void);
+void simtemp_genl_unregister(void);
+void simtemp_genl_init(struct simtemp_device *dev);
+void simtemp_genl_exit(struct simtemp_device *dev);
+void simtemp_genl_notify(struct simtemp_device *dev,
+                         const struct simtemp_event *ev);
+#else
+static inline int simtemp_genl_register(void) { return 0; }
+static inline void simtemp_genl_unregister(void) { }
+static inline void simtemp_genl_init(struct simtemp_device *dev) { }
+static inline void simtemp_genl_exit(struct simtemp_device *dev) { }
+static inline void simtemp_genl_notify(struct simtemp_device *dev,
+                                       const struct simtemp_event *ev) { }
+#endif
+
+/* nxp_simtemp_relay.c */
+#if IS_ENABLED(CONFIG_RELAY)
+void simtemp_relay_init(struct simtemp_device *dev);
+void simtemp_relay_exit(struct simtemp_device *dev);
+void simtemp_relay_write(struct simtemp_device *dev,
+                         const struct simtemp_sample_v2 *samples,
+                         unsigned int n);
+#else
+static inline void simtemp_relay_init(struct simtemp_device *dev) { }
+static inline void simtemp_relay_exit(struct simtemp_device *dev) { }
+static inline void simtemp_relay_write(struct simtemp_device *dev,
+                                       const struct simtemp_sample_v2 *samples,
+                                       unsigned int n) { }
+#endif
+
+/* nxp_simtemp_configfs.c */
+#if IS_ENABLED(CONFIG_CONFIGFS_FS)
+int simtemp_configfs_init(void);
+void simtemp_configfs_exit(void);
+#else
+static inline int simtemp_configfs_init(void) { return 0; }
+static inline void simtemp_configfs_exit(void) { }
+#endif
+
+/* nxp_simtemp_debugfs.c */
+int simtemp_stats_init(struct simtemp_device *dev);
+void simtemp_stats_exit(struct simtemp_device *dev);
+void simtemp_stats_reset(struct simtemp_device *dev);
+int simtemp_reader_stats_init(struct simtemp_reader *reader);
+void simtemp_reader_stats_exit(struct simtemp_reader *reader);
+void simtemp_debugfs_init(void);
+void simtemp_debugfs_exit(void);
+
+#endif /* _NXP_SIMTEMP_H */
@@ -0,0 +1,309 @@
+/*
+ * nxp_simtemp_configfs.c - Runtime creation of simtemp instances
+ *
+ * Every directory made under /sys/kernel/config/nxp_simtemp/ registers
+ * a new platform device, which the driver probes like any other
+ * instance; rmdir unregisters it again:
+ *
+ *   mkdir /sys/kernel/config/nxp_simtemp/hot0
+ *   cat /sys/kernel/config/nxp_simtemp/hot0/dev        -> simtemp3
+ *   echo 10 > /sys/kernel/config/nxp_simtemp/hot0/sampling_ms
+ *   rmdir /sys/kernel/config/nxp_simtemp/hot0
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/configfs.h>
+#include <linux/platform_device.h>
+
+#include "nxp_simtemp.h"
+
+struct simtemp_cfs_item {
+    struct config_item item;
+    struct platform_device *pdev;
+};
+
+static struct platform_device *to_simtemp_pdev(struct config_item *item)
+{
+    return container_of(item, struct simtemp_cfs_item, item)->pdev;
+}
+
+/*
+ * The platform device lives as long as the item, but the driver can be
+ * unbound from it through sysfs in the meantime. Attributes run under
+ * the device lock, like simtemp_remove(), and fail with -ENODEV while
+ * no driver instance is bound. Returns NULL, unlocked, in that case.
+ */
+static struct simtemp_device *simtemp_cfs_lock(struct config_item *item)
+{
+    struct platform_device *pdev = to_simtemp_pdev(item);
+    struct simtemp_device *dev;
+
+    device_lock(&pdev->dev);
+    dev = platform_get_drvdata(pdev);
+    if (!dev)
+        device_unlock(&pdev->dev);
+
+    return dev;
+}
+
+static void simtemp_cfs_unlock(struct config_item *item)
+{
+    device_unlock(&to_simtemp_pdev(item)->dev);
+}
+
+static ssize_t simtemp_cfs_dev_show(struct config_item *item, char *page)
+{
+    struct simtemp_device *dev = simtemp_cfs_lock(item);
+    ssize_t ret;
+
+    if (!dev)
+        return -ENODEV;
+
+    ret = sysfs_emit(page, "%s\n", dev->name);
+    simtemp_cfs_unlock(item);
+    return ret;
+}
+
+static ssize_t simtemp_cfs_sampling_ms_show(struct config_item *item,
+                                            char *page)
+{
+    struct simtemp_device *dev = simtemp_cfs_lock(item);
+    ssize_t ret;
+
+    if (!dev)
+        return -ENODEV;
+
+    ret = sysfs_emit(page, "%u\n", READ_ONCE(dev->sampling_ms));
+    simtemp_cfs_unlock(item);
+    return ret;
+}
+
+static ssize_t simtemp_cfs_sampling_ms_store(struct config_item *item,
+                                             const char *page, size_t count)
+{
+    struct simtemp_device *dev;
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(page, 0, &val);
+    if (ret)
+        return ret;
+    if (!val)
+        return -EINVAL;
+
+    dev = simtemp_cfs_lock(item);
+    if (!dev)
+        return -ENODEV;
+
+    ret = simtemp_set_sampling_ms(dev, val);
+    simtemp_cfs_unlock(item);
+    return ret ? ret : count;
+}
+
+static ssize_t simtemp_cfs_threshold_mC_show(struct config_item *item,
+                                             char *page)
+{
+    struct simtemp_device *dev = simtemp_cfs_lock(item);
+    ssize_t ret;
+
+    if (!dev)
+        return -ENODEV;
+
+    ret = sysfs_emit(page, "%d\n", READ_ONCE(dev->threshold_mC));
+    simtemp_cfs_unlock(item);
+    return ret;
+}
+
+static ssize_t simtemp_cfs_threshold_mC_store(struct config_item *item,
+                                              const char *page, size_t count)
+{
+    struct simtemp_device *dev;
+    s32 val;
+    int ret;
+
+    ret = kstrtos32(page, 0, &val);
+    if (ret)
+        return ret;
+
+    dev = simtemp_cfs_lock(item);
+    if (!dev)
+        return -ENODEV;
+
+    simtemp_set_threshold(dev, val);
+    simtemp_cfs_unlock(item);
+    return count;
+}
+
+static ssize_t simtemp_cfs_base_temp_mC_show(struct config_item *item,
+                                             char *page)
+{
+    struct simtemp_device *dev = simtemp_cfs_lock(item);
+    ssize_t ret;
+
+    if (!dev)
+        return -ENODEV;
+
+    ret = sysfs_emit(page, "%d\n", READ_ONCE(dev->base_temp_mC));
+    simtemp_cfs_unlock(item);
+    return ret;
+}
+
+static ssize_t simtemp_cfs_base_temp_mC_store(struct config_item *item,
+                                              const char *page, size_t count)
+{
+    struct simtemp_device *dev;
+    s32 val;
+    int ret;
+
+    ret = kstrtos32(page, 0, &val);
+    if (ret)
+        return ret;
+
+    dev = simtemp_cfs_lock(item);
+    if (!dev)
+        return -ENODEV;
+
+    WRITE_ONCE(dev->base_temp_mC, val);
+    simtemp_cfs_unlock(item);
+    return count;
+}
+
+static ssize_t simtemp_cfs_temp_variation_mC_show(struct config_item *item,
+                                                  char *page)
+{
+    struct simtemp_device *dev = simtemp_cfs_lock(item);
+    ssize_t ret;
+
+    if (!dev)
+        return -ENODEV;
+
+    ret = sysfs_emit(page, "%u\n", READ_ONCE(dev->temp_variation_mC));
+    simtemp_cfs_unlock(item);
+    return ret;
+}
+
+static ssize_t simtemp_cfs_temp_variation_mC_store(struct config_item *item,
+                                                   const char *page,
+                                                   size_t count)
+{
+    struct simtemp_device *dev;
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(page, 0, &val);
+    if (ret)
+        return ret;
+    /* Keeps 2 * variation + 1 and base +- variation within range */
+    if (val > 1000000)
+        return -EINVAL;
+
+    dev = simtemp_cfs_lock(item);
+    if (!dev)
+        return -ENODEV;
+
+    /* Also the amplitude of the waveform profiles */
+    mutex_lock(&dev->gen_lock);
+    WRITE_ONCE(dev->temp_variation_mC, val);
+    simtemp_wave_update(dev);
+    mutex_unlock(&dev->gen_lock);
+    simtemp_cfs_unlock(item);
+    return count;
+}
+
+CONFIGFS_ATTR_RO(simtemp_cfs_, dev);
+CONFIGFS_ATTR(simtemp_cfs_, sampling_ms);
+CONFIGFS_ATTR(simtemp_cfs_, threshold_mC);
+CONFIGFS_ATTR(simtemp_cfs_, base_temp_mC);
+CONFIGFS_ATTR(simtemp_cfs_, temp_variation_mC);
+
+static struct configfs_attribute *simtemp_cfs_attrs[] = {
+    &simtemp_cfs_attr_dev,
+    &simtemp_cfs_attr_sampling_ms,
+    &simtemp_cfs_attr_threshold_mC,
+    &simtemp_cfs_attr_base_temp_mC,
+    &simtemp_cfs_attr_temp_variation_mC,
+    NULL,
+};
+
+/* Last reference gone (rmdir and no attribute file open): drop the sensor */
+static void simtemp_cfs_release(struct config_item *item)
+{
+    struct simtemp_cfs_item *cfs = container_of(item, struct simtemp_cfs_item,
+                                                item);
+
+    platform_device_unregister(cfs->pdev);
+    kfree(cfs);
+}
+
+static struct configfs_item_operations simtemp_cfs_item_ops = {
+    .release = simtemp_cfs_release,
+};
+
+static const struct config_item_type simtemp_cfs_item_type = {
+    .ct_item_ops = &simtemp_cfs_item_ops,
+    .ct_attrs = simtemp_cfs_attrs,
+    .ct_owner = THIS_MODULE,
+};
+
+static struct config_item *simtemp_cfs_make_item(struct config_group *group,
+                                                 const char *name)
+{
+    struct simtemp_cfs_item *cfs;
+    struct platform_device *pdev;
+
+    cfs = kzalloc(sizeof(*cfs), GFP_KERNEL);
+    if (!cfs)
+        return ERR_PTR(-ENOMEM);
+
+    pdev = platform_device_register_simple(DRIVER_NAME, PLATFORM_DEVID_AUTO,
+                                           NULL, 0);
+    if (IS_ERR(pdev)) {
+        kfree(cfs);
+        return ERR_CAST(pdev);
+    }
+
+    /* The driver probes synchronously; no drvdata means probe failed */
+    if (!platform_get_drvdata(pdev)) {
+        platform_device_unregister(pdev);
+        kfree(cfs);
+        return ERR_PTR(-ENODEV);
+    }
+
+    cfs->pdev = pdev;
+    config_item_init_type_name(&cfs->item, name, &simtemp_cfs_item_type);
+
+    return &cfs->item;
+}
+
+static struct configfs_group_operations simtemp_cfs_group_ops = {
+    .make_item = simtemp_cfs_make_item,
+};
+
+static const struct config_item_type simtemp_cfs_group_type = {
+    .ct_group_ops = &simtemp_cfs_group_ops,
+    .ct_owner = THIS_MODULE,
+};
+
+static struct configfs_subsystem simtemp_cfs_subsys = {
+    .su_group = {
+        .cg_item = {
+            .ci_namebuf = DRIVER_NAME,
+            .ci_type = &simtemp_cfs_group_type,
+        },
+    },
+};
+
+int simtemp_configfs_init(void)
+{
+    config_group_init(&simtemp_cfs_subsys.su_group);
+    mutex_init(&simtemp_cfs_subsys.su_mutex);
+
+    return configfs_register_subsystem(&simtemp_cfs_subsys);
+}
+
+void simtemp_configfs_exit(void)
+{
+    configfs_unregister_subsystem(&simtemp_cfs_subsys);
+}
@@ -0,0 +1,196 @@
+/*
+ * nxp_simtemp_core.c - Broadcast ring buffer of nxp_simtemp
+ *
+ * Builds in the kernel and in user space, see nxp_simtemp_core.h.
+ */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#endif
+
+#include "nxp_simtemp_core.h"
+
+/*
+ * Ring buffer operations
+ *
+ * The ring is broadcast: the producer only advances head, every open
+ * file owns a cursor (a sequence number) and consumes independently.
+ * A reader that falls more than one ring size behind loses the oldest
+ * samples, which is accounted as an overflow of that reader.
+ */
+
+/**
+ * ring_buffer_init - Initialize ring buffer
+ * @ring_buf: Ring buffer to initialize
+ * @samples: Zeroed storage for @size samples
+ * @size: Capacity, a power of 2
+ * @counters: Per-CPU counters charged for overwrites and lock contention
+ */
+void ring_buffer_init(struct simtemp_ring_buffer *ring_buf,
+                      struct simtemp_sample_v2 *samples, u32 size,
+                      struct simtemp_counters __percpu *counters)
+{
+    ring_buf->samples = samples;
+    ring_buf->size = size;
+    ring_buf->head = 0;
+    spin_lock_init(&ring_buf->lock);
+    ring_buf->counters = counters;
+}
+
+/*
+ * Take the ring lock, counting the acquisitions that find it busy.
+ * The trylock costs nothing extra in the uncontended case.
+ */
+#define ring_buffer_lock(ring_buf, flags)                               \
+    do {                                                                \
+        if (!spin_trylock_irqsave(&(ring_buf)->lock, flags)) {          \
+            simtemp_count((ring_buf)->counters, lock_contended);        \
+            spin_lock_irqsave(&(ring_buf)->lock, flags);                \
+        }                                                               \
+    } while (0)
+
+/**
+ * ring_buffer_oldest - Sequence number of the oldest sample still held
+ * @ring_buf: Ring buffer
+ * 
+ * Note: Must be called with lock held
+ */
+u64 ring_buffer_oldest(struct simtemp_ring_buffer *ring_buf)
+{
+    return ring_buf->head > ring_buf->size ?
+           ring_buf->head - ring_buf->size : 0;
+}
+
+/*
+ * Move @cursor past whatever was overwritten since the last visit.
+ * Must be called with lock held. Returns the number of samples lost to
+ * this reader; the overwritten counter is kept by ring_buffer_put().
+ */
+static u64 ring_buffer_skip_lost(struct simtemp_ring_buffer *ring_buf,
+                                 u64 *cursor)
+{
+    u64 oldest = ring_buffer_oldest(ring_buf);
+    u64 lost;
+
+    if (*cursor >= oldest)
+        return 0;
+
+    lost = oldest - *cursor;
+    *cursor = oldest;
+
+    return lost;
+}
+
+/**
+ * ring_buffer_put - Add samples to ring buffer
+ * @ring_buf: Ring buffer
+ * @samples: Samples to add
+ * @n: Number of samples, at most the ring size
+ * 
+ * Once the ring is full the oldest slots are simply reused. Readers that
+ * had not consumed them notice on their next ring_buffer_get(). Every
+ * sample pushed out is counted once in overwritten, however many
+ * readers (none included) still wanted it.
+ * 
+ * Returns: the new head
+ */
+u64 ring_buffer_put(struct simtemp_ring_buffer *ring_buf,
+                    const struct simtemp_sample_v2 *samples,
+                    unsigned int n)
+{
+    unsigned long flags;
+    unsigned int i;
+    u64 oldest, head;
+
+    ring_buffer_lock(ring_buf, flags);
+
+    oldest = ring_buffer_oldest(ring_buf);
+
+    /* Add new samples at head */
+    for (i = 0; i < n; i++)
+        ring_buf->samples[(ring_buf->head + i) & (ring_buf->size - 1)] =
+            samples[i];
+    head = ring_buf->head += n;
+
+    if (ring_buffer_oldest(ring_buf) > oldest)
+        this_cpu_add(ring_buf->counters->overwritten,
+                     ring_buffer_oldest(ring_buf) - oldest);
+
+    spin_unlock_irqrestore(&ring_buf->lock, flags);
+
+    return head;
+}
+
+/**
+ * ring_buffer_peek - Timestamp of the next sample of a reader
+ * @ring_buf: Ring buffer
+ * @cursor: Reader cursor, moved past overwritten samples
+ * @timestamp_ns: Receives the timestamp of the sample at @cursor
+ * @lost: Receives the number of samples overwritten before this reader
+ *        could consume them
+ * 
+ * Returns: false if the reader is up to date
+ */
+bool ring_buffer_peek(struct simtemp_ring_buffer *ring_buf,
+                      u64 *cursor, u64 *timestamp_ns, u64 *lost)
+{
+    unsigned long flags;
+    bool avail;
+
+    ring_buffer_lock(ring_buf, flags);
+
+    *lost = ring_buffer_skip_lost(ring_buf, cursor);
+    avail = *cursor < ring_buf->head;
+    if (avail)
+        *timestamp_ns =
+            ring_buf->samples[*cursor & (ring_buf->size - 1)].timestamp_ns;
+
+    spin_unlock_irqrestore(&ring_buf->lock, flags);
+
+    return avail;
+}
+
+/**
+ * ring_buffer_get - Get samples from ring buffer
+ * @ring_buf: Ring buffer
+ * @cursor: Reader cursor, advanced past the returned samples
+ * @samples: Output array
+ * @max: Capacity of @samples
+ * @until_ns: Stop at the first sample stamped later than this
+ * @first_seq: Receives the sequence number of @samples[0]
+ * @lost: Receives the number of samples overwritten before this reader
+ *        could consume them
+ * 
+ * Returns: number of samples copied, 0 if the reader is up to date
+ */
+unsigned int ring_buffer_get(struct simtemp_ring_buffer *ring_buf,
+                             u64 *cursor,
+                             struct simtemp_sample_v2 *samples,
+                             unsigned int max, u64 until_ns,
+                             u64 *first_seq, u64 *lost)
+{
+    const struct simtemp_sample_v2 *s;
+    unsigned long flags;
+    unsigned int n, i;
+
+    ring_buffer_lock(ring_buf, flags);
+
+    *lost = ring_buffer_skip_lost(ring_buf, cursor);
+
+    n = min_t(u64, ring_buf->head - *cursor, max);
+    *first_seq = *cursor;
+
+    for (i = 0; i < n; i++) {
+        s = &ring_buf->samples[(*cursor + i) & (ring_buf->size - 1)];
+        if (s->timestamp_ns > until_ns)
+            break;
+        samples[i] = *s;
+    }
+    *cursor += i;
+
+    spin_unlock_irqrestore(&ring_buf->lock, flags);
+
+    return i;
+}
+
+
@@ -0,0 +1,94 @@
+/*
+ * nxp_simtemp_core.h - Ring buffer and sample generator core
+ *
+ * The hot path of nxp_simtemp without any device state: the broadcast
+ * ring and the per-sample generator arithmetic. The same sources build
+ * into the module and, with the shims of userspace/core/simtemp_user.h,
+ * into a user space library for unit tests and benchmarks:
+ *
+ *   make -C userspace/core test bench
+ *
+ * Keep this file and nxp_simtemp_core.c free of kernel-only APIs other
+ * than those shimmed there.
+ */
+
+#ifndef _NXP_SIMTEMP_CORE_H
+#define _NXP_SIMTEMP_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#else
+#include "simtemp_user.h"
+#endif
+
+#include "nxp_simtemp_ioctl.h"
+
+/* Waveform table entries (power of 2), indexed by the top phase bits */
+#define SIMTEMP_WAVE_BITS   10
+#define SIMTEMP_WAVE_SIZE   (1 << SIMTEMP_WAVE_BITS)
+
+/* Channel phase offset, 2^32 / golden ratio, scatters the channels */
+#define SIMTEMP_WAVE_SPREAD 0x9e3779b9U
+
+/* Ring buffer structure */
+struct simtemp_ring_buffer {
+    struct simtemp_sample_v2 *samples;
+    u32 size;           /* Capacity, power of 2 */
+    u64 head;           /* Sequence number of the next write */
+    spinlock_t lock;    /* Protects buffer access */
+
+    /* Owner's counters (overwritten, lock_contended) */
+    struct simtemp_counters __percpu *counters;
+};
+
+/* Bump one per-CPU driver counter, e.g. simtemp_count(dev->counters, delivered) */
+#define simtemp_count(counters, field) this_cpu_inc((counters)->field)
+
+void ring_buffer_init(struct simtemp_ring_buffer *ring_buf,
+                      struct simtemp_sample_v2 *samples, u32 size,
+                      struct simtemp_counters __percpu *counters);
+u64 ring_buffer_put(struct simtemp_ring_buffer *ring_buf,
+                    const struct simtemp_sample_v2 *samples, unsigned int n);
+u64 ring_buffer_oldest(struct simtemp_ring_buffer *ring_buf);
+bool ring_buffer_peek(struct simtemp_ring_buffer *ring_buf,
+                      u64 *cursor, u64 *timestamp_ns, u64 *lost);
+unsigned int ring_buffer_get(struct simtemp_ring_buffer *ring_buf, u64 *cursor,
+                             struct simtemp_sample_v2 *samples,
+                             unsigned int max, u64 until_ns,
+                             u64 *first_seq, u64 *lost);
+
+/*
+ * Generator arithmetic
+ *
+ * Random input is passed in, so callers pick the source: get_random_u32()
+ * in the driver, a fixed sequence in tests.
+ */
+
+/* Uniform value in [center - spread_mC, center + spread_mC] */
+static inline s32 simtemp_core_noise(s32 center_mC, u32 spread_mC, u32 rnd)
+{
+    return center_mC + (s32)(rnd % (2 * spread_mC + 1)) - (s32)spread_mC;
+}
+
+/* Entry of a waveform table at a phase, 2^32 is one cycle */
+static inline s32 simtemp_core_wave(const s32 *table, u32 phase)
+{
+    return READ_ONCE(table[phase >> (32 - SIMTEMP_WAVE_BITS)]);
+}
+
+/* Flags of a generated value, exceeding means strictly above */
+static inline u32 simtemp_core_flags(s32 temp_mC, s32 threshold_mC,
+                                     u32 period_flags)
+{
+    u32 flags = SIMTEMP_FLAG_NEW_SAMPLE | period_flags;
+
+    if (temp_mC > threshold_mC)
+        flags |= SIMTEMP_FLAG_THRESHOLD_EXCEEDED;
+
+    return flags;
+}
+
+#endif /* _NXP_SIMTEMP_CORE_H */
@@ -0,0 +1,313 @@
+/*
+ * nxp_simtemp_debugfs.c - Generator timing statistics for nxp_simtemp
+ *
+ * Exposes per-device log2 histograms under
+ * /sys/kernel/debug/nxp_simtemp/<device>/ together with a reset knob.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+#include "nxp_simtemp.h"
+
+/* Percentiles reported for every histogram, in tenths of a percent */
+static const unsigned int simtemp_percentiles[] = { 500, 900, 990, 999 };
+
+static struct dentry *simtemp_debugfs_root;
+
+/*
+ * Histogram helpers
+ */
+
+static int simtemp_hist_init(struct simtemp_hist *hist, const char *unit)
+{
+    hist->pcpu = alloc_percpu(struct simtemp_hist_cpu);
+    if (!hist->pcpu)
+        return -ENOMEM;
+
+    hist->unit = unit;
+    return 0;
+}
+
+static void simtemp_hist_free(struct simtemp_hist *hist)
+{
+    free_percpu(hist->pcpu);
+    hist->pcpu = NULL;
+}
+
+static void simtemp_hist_reset(struct simtemp_hist *hist)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(hist->pcpu, cpu), 0,
+               sizeof(struct simtemp_hist_cpu));
+}
+
+/**
+ * simtemp_hist_sum - Fold all per-CPU copies into one
+ * @hist: Histogram
+ * @out: Accumulated result
+ *
+ * Returns: total number of recorded values
+ *
+ * Counters keep moving while we sum them, so the result is only a
+ * close approximation of a single instant. That is fine for stats.
+ */
+static u64 simtemp_hist_sum(struct simtemp_hist *hist,
+                            struct simtemp_hist_cpu *out)
+{
+    u64 total = 0;
+    int cpu, i;
+
+    memset(out, 0, sizeof(*out));
+
+    for_each_possible_cpu(cpu) {
+        struct simtemp_hist_cpu *h = per_cpu_ptr(hist->pcpu, cpu);
+
+        for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++)
+            out->count[i] += READ_ONCE(h->count[i]);
+        out->sum += READ_ONCE(h->sum);
+        out->max = max(out->max, READ_ONCE(h->max));
+    }
+
+    for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++)
+        total += out->count[i];
+
+    return total;
+}
+
+/* Largest value that falls into @bucket */
+static u64 simtemp_hist_bucket_max(unsigned int bucket)
+{
+    if (bucket == 0)
+        return 0;
+    if (bucket >= 64)
+        return U64_MAX;
+    return (1ULL << bucket) - 1;
+}
+
+static int simtemp_hist_print(struct seq_file *m, struct simtemp_hist *hist)
+{
+    struct simtemp_hist_cpu *acc;
+    u64 total, cumulative;
+    unsigned int i, p;
+
+    acc = kzalloc(sizeof(*acc), GFP_KERNEL);
+    if (!acc)
+        return -ENOMEM;
+
+    total = simtemp_hist_sum(hist, acc);
+
+    seq_printf(m, "count: %llu\n", total);
+    seq_printf(m, "mean:  %llu %s\n",
+               total ? div64_u64(acc->sum, total) : 0, hist->unit);
+    seq_printf(m, "max:   %llu %s\n", acc->max, hist->unit);
+
+    /* Percentiles resolve to the upper bound of the matching bucket */
+    for (p = 0; p < ARRAY_SIZE(simtemp_percentiles); p++) {
+        u64 rank = div_u64(total * simtemp_percentiles[p] + 999, 1000);
+
+        cumulative = 0;
+        for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++) {
+            cumulative += acc->count[i];
+            if (total && cumulative >= rank)
+                break;
+        }
+        seq_printf(m, "p%u.%u: <= %llu %s\n",
+                   simtemp_percentiles[p] / 10, simtemp_percentiles[p] % 10,
+                   total ? simtemp_hist_bucket_max(i) : 0, hist->unit);
+    }
+
+    seq_puts(m, "buckets:\n");
+    for (i = 0; i < SIMTEMP_HIST_BUCKETS; i++) {
+        if (!acc->count[i])
+            continue;
+        seq_printf(m, "  <= %-20llu %llu\n",
+                   simtemp_hist_bucket_max(i), acc->count[i]);
+    }
+
+    kfree(acc);
+    return 0;
+}
+
+static int simtemp_hist_show(struct seq_file *m, void *unused)
+{
+    return simtemp_hist_print(m, m->private);
+}
+DEFINE_SHOW_ATTRIBUTE(simtemp_hist);
+
+static int simtemp_reader_show(struct seq_file *m, void *unused)
+{
+    struct simtemp_reader *reader = m->private;
+
+    seq_printf(m, "pid:   %d\n", reader->pid);
+    seq_printf(m, "comm:  %s\n", reader->comm);
+    seq_puts(m, "delivery_latency:\n");
+    return simtemp_hist_print(m, &reader->delivery_latency);
+}
+DEFINE_SHOW_ATTRIBUTE(simtemp_reader);
+
+/**
+ * simtemp_stats_reset - Clear every device-wide histogram
+ * @dev: Device structure
+ */
+void simtemp_stats_reset(struct simtemp_device *dev)
+{
+    struct simtemp_stats *stats = &dev->stats;
+
+    simtemp_hist_reset(&stats->timer_lateness);
+    simtemp_hist_reset(&stats->callback_duration);
+    simtemp_hist_reset(&stats->ring_occupancy);
+    simtemp_hist_reset(&stats->delivery_latency);
+}
+
+/*
+ * Writing anything to "reset" clears every histogram of the device
+ */
+static ssize_t simtemp_stats_reset_write(struct file *filp,
+                                         const char __user *buf,
+                                         size_t count, loff_t *ppos)
+{
+    simtemp_stats_reset(filp->private_data);
+    return count;
+}
+
+static const struct file_operations simtemp_stats_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = simtemp_stats_reset_write,
+    .llseek = noop_llseek,
+};
+
+/**
+ * simtemp_stats_init - Allocate histograms and create debugfs entries
+ * @dev: Device structure
+ *
+ * Returns: 0 on success, -ENOMEM if the histograms cannot be allocated.
+ * debugfs failures are not fatal, the statistics are simply not shown.
+ */
+int simtemp_stats_init(struct simtemp_device *dev)
+{
+    struct simtemp_stats *stats = &dev->stats;
+    int ret;
+
+    ret = simtemp_hist_init(&stats->timer_lateness, "ns");
+    if (ret)
+        return ret;
+
+    ret = simtemp_hist_init(&stats->callback_duration, "ns");
+    if (ret)
+        goto err_lateness;
+
+    ret = simtemp_hist_init(&stats->ring_occupancy, "samples");
+    if (ret)
+        goto err_duration;
+
+    ret = simtemp_hist_init(&stats->delivery_latency, "ns");
+    if (ret)
+        goto err_occupancy;
+
+    atomic_set(&stats->reader_ids, 0);
+
+    stats->debugfs_dir = debugfs_create_dir(dev_name(&dev->pdev->dev),
+                                            simtemp_debugfs_root);
+    debugfs_create_file("timer_lateness", 0444, stats->debugfs_dir,
+                        &stats->timer_lateness, &simtemp_hist_fops);
+    debugfs_create_file("callback_duration", 0444, stats->debugfs_dir,
+                        &stats->callback_duration, &simtemp_hist_fops);
+    debugfs_create_file("ring_occupancy", 0444, stats->debugfs_dir,
+                        &stats->ring_occupancy, &simtemp_hist_fops);
+    debugfs_create_file("delivery_latency", 0444, stats->debugfs_dir,
+                        &stats->delivery_latency, &simtemp_hist_fops);
+    debugfs_create_file("reset", 0200, stats->debugfs_dir,
+                        dev, &simtemp_stats_reset_fops);
+    stats->readers_dir = debugfs_create_dir("readers", stats->debugfs_dir);
+
+    return 0;
+
+err_occupancy:
+    simtemp_hist_free(&stats->ring_occupancy);
+err_duration:
+    simtemp_hist_free(&stats->callback_duration);
+err_lateness:
+    simtemp_hist_free(&stats->timer_lateness);
+    return ret;
+}
+
+/**
+ * simtemp_stats_exit - Remove debugfs entries and free histograms
+ * @dev: Device structure
+ *
+ * Must be called after the timer has been stopped.
+ */
+void simtemp_stats_exit(struct simtemp_device *dev)
+{
+    struct simtemp_stats *stats = &dev->stats;
+
+    debugfs_remove_recursive(stats->debugfs_dir);
+    stats->debugfs_dir = NULL;
+    stats->readers_dir = NULL;
+
+    simtemp_hist_free(&stats->delivery_latency);
+    simtemp_hist_free(&stats->ring_occupancy);
+    simtemp_hist_free(&stats->callback_duration);
+    simtemp_hist_free(&stats->timer_lateness);
+}
+
+/**
+ * simtemp_reader_stats_init - Per open file delivery latency histogram
+ * @reader: Reader state, @reader->dev must be set
+ *
+ * Creates readers/<id>-<pid> in the device debugfs directory. The file
+ * lives as long as the open file does.
+ *
+ * Returns: 0 on success, -ENOMEM on allocation failure
+ */
+int simtemp_reader_stats_init(struct simtemp_reader *reader)
+{
+    struct simtemp_stats *stats = &reader->dev->stats;
+    char name[32];
+    int ret;
+
+    ret = simtemp_hist_init(&reader->delivery_latency, "ns");
+    if (ret)
+        return ret;
+
+    reader->pid = task_tgid_vnr(current);
+    get_task_comm(reader->comm, current);
+
+    snprintf(name, sizeof(name), "%d-%d",
+             atomic_inc_return(&stats->reader_ids), reader->pid);
+    reader->debugfs_file = debugfs_create_file(name, 0444, stats->readers_dir,
+                                               reader, &simtemp_reader_fops);
+
+    return 0;
+}
+
+void simtemp_reader_stats_exit(struct simtemp_reader *reader)
+{
+    /* Waits for any concurrent show() to finish */
+    debugfs_remove(reader->debugfs_file);
+    reader->debugfs_file = NULL;
+
+    simtemp_hist_free(&reader->delivery_latency);
+}
+
+void simtemp_debugfs_init(void)
+{
+    simtemp_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+}
+
+void simtemp_debugfs_exit(void)
+{
+    debugfs_remove_recursive(simtemp_debugfs_root);
+    simtemp_debugfs_root = NULL;
+}
@@ -0,0 +1,128 @@
+/*
+ * nxp_simtemp_genl.c - Generic netlink event channel for nxp_simtemp
+ *
+ * Threshold crossings and reader overflows are multicast to the
+ * "events" group of the "nxp_simtemp" family (nxp_simtemp_genl.h), so
+ * any number of daemons can watch for alerts without reading the
+ * sample stream. The sampling path only checks for listeners and
+ * queues a small record; messages are built and sent from a work item.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kfifo.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
+
+#include "nxp_simtemp.h"
+#include "nxp_simtemp_genl.h"
+
+static const struct genl_multicast_group simtemp_genl_mcgrps[] = {
+    { .name = SIMTEMP_GENL_MCGRP_EVENTS, },
+};
+
+static struct genl_family simtemp_genl_family __ro_after_init = {
+    .name = SIMTEMP_GENL_NAME,
+    .version = SIMTEMP_GENL_VERSION,
+    .maxattr = SIMTEMP_GENL_ATTR_MAX,
+    .module = THIS_MODULE,
+    .mcgrps = simtemp_genl_mcgrps,
+    .n_mcgrps = ARRAY_SIZE(simtemp_genl_mcgrps),
+    .resv_start_op = SIMTEMP_GENL_CMD_EVENT + 1,
+};
+
+static int simtemp_genl_fill(struct sk_buff *skb, struct simtemp_device *dev,
+                             const struct simtemp_event *ev)
+{
+    void *hdr;
+
+    hdr = genlmsg_put(skb, 0, 0, &simtemp_genl_family, 0,
+                      SIMTEMP_GENL_CMD_EVENT);
+    if (!hdr)
+        return -EMSGSIZE;
+
+    if (nla_put_string(skb, SIMTEMP_GENL_ATTR_DEVICE, dev->name) ||
+        nla_put_u32(skb, SIMTEMP_GENL_ATTR_TYPE, ev->type) ||
+        nla_put_u64_64bit(skb, SIMTEMP_GENL_ATTR_TIMESTAMP, ev->timestamp_ns,
+                          SIMTEMP_GENL_ATTR_PAD))
+        goto err_cancel;
+
+    if (ev->type == SIMTEMP_GENL_EVENT_OVERFLOW) {
+        if (nla_put_u32(skb, SIMTEMP_GENL_ATTR_PID, ev->pid) ||
+            nla_put_u64_64bit(skb, SIMTEMP_GENL_ATTR_LOST, ev->lost,
+                              SIMTEMP_GENL_ATTR_PAD))
+            goto err_cancel;
+    } else if (nla_put_s32(skb, SIMTEMP_GENL_ATTR_THRESHOLD, ev->threshold_mC)) {
+        goto err_cancel;
+    }
+
+    genlmsg_end(skb, hdr);
+    return 0;
+
+err_cancel:
+    genlmsg_cancel(skb, hdr);
+    return -EMSGSIZE;
+}
+
+static void simtemp_genl_work(struct work_struct *work)
+{
+    struct simtemp_device *dev = container_of(work, struct simtemp_device,
+                                              events.work);
+    struct simtemp_event ev;
+    struct sk_buff *skb;
+
+    while (kfifo_out_spinlocked(&dev->events.fifo, &ev, 1,
+                                &dev->events.lock)) {
+        skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+        if (!skb)
+            return;
+
+        if (simtemp_genl_fill(skb, dev, &ev)) {
+            nlmsg_free(skb);
+            continue;
+        }
+
+        /* -ESRCH only means the last listener just left */
+        genlmsg_multicast(&simtemp_genl_family, skb, 0, 0, GFP_KERNEL);
+    }
+}
+
+/**
+ * simtemp_genl_notify - Queue an event for the multicast group
+ * @dev: Device structure
+ * @ev: Event, copied
+ *
+ * Safe from any context. Costs one check while nobody listens; when
+ * the queue is full the event is dropped.
+ */
+void simtemp_genl_notify(struct simtemp_device *dev,
+                         const struct simtemp_event *ev)
+{
+    if (!genl_has_listeners(&simtemp_genl_family, &init_net, 0))
+        return;
+
+    if (kfifo_in_spinlocked(&dev->events.fifo, ev, 1, &dev->events.lock))
+        schedule_work(&dev->events.work);
+}
+
+void simtemp_genl_init(struct simtemp_device *dev)
+{
+    spin_lock_init(&dev->events.lock);
+    INIT_KFIFO(dev->events.fifo);
+    INIT_WORK(&dev->events.work, simtemp_genl_work);
+}
+
+/* Last reference to the device is gone, nothing queues events any more */
+void simtemp_genl_exit(struct simtemp_device *dev)
+{
+    cancel_work_sync(&dev->events.work);
+}
+
+int simtemp_genl_register(void)
+{
+    return genl_register_family(&simtemp_genl_family);
+}
+
+void simtemp_genl_unregister(void)
+{
+    genl_unregister_family(&simtemp_genl_family);
+}
@@ -0,0 +1,47 @@
+/*
+ * nxp_simtemp_genl.h - NXP Simulated Temperature Sensor netlink events
+ *
+ * Generic netlink family "nxp_simtemp" with one multicast group,
+ * "events". Subscribers receive a SIMTEMP_GENL_CMD_EVENT message for
+ * every threshold crossing and every reader overflow of any instance,
+ * without opening the devices:
+ *
+ *   genl-ctrl-list, then nl_socket_add_membership() on the group id
+ */
+
+#ifndef _NXP_SIMTEMP_GENL_H
+#define _NXP_SIMTEMP_GENL_H
+
+#define SIMTEMP_GENL_NAME           "nxp_simtemp"
+#define SIMTEMP_GENL_VERSION        1
+#define SIMTEMP_GENL_MCGRP_EVENTS   "events"
+
+enum simtemp_genl_cmd {
+    SIMTEMP_GENL_CMD_UNSPEC,
+    SIMTEMP_GENL_CMD_EVENT,         /* Multicast only */
+
+    __SIMTEMP_GENL_CMD_MAX,
+};
+#define SIMTEMP_GENL_CMD_MAX (__SIMTEMP_GENL_CMD_MAX - 1)
+
+enum simtemp_genl_event_type {
+    SIMTEMP_GENL_EVENT_THRESHOLD_UP,    /* A channel went over the threshold */
+    SIMTEMP_GENL_EVENT_THRESHOLD_DOWN,  /* No channel is over it any more */
+    SIMTEMP_GENL_EVENT_OVERFLOW,        /* A reader lost samples */
+};
+
+enum simtemp_genl_attr {
+    SIMTEMP_GENL_ATTR_UNSPEC,
+    SIMTEMP_GENL_ATTR_PAD,
+    SIMTEMP_GENL_ATTR_DEVICE,       /* string: simtemp, simtemp1, ... */
+    SIMTEMP_GENL_ATTR_TYPE,         /* u32: enum simtemp_genl_event_type */
+    SIMTEMP_GENL_ATTR_TIMESTAMP,    /* u64: CLOCK_MONOTONIC ns of the period */
+    SIMTEMP_GENL_ATTR_THRESHOLD,    /* s32: threshold_mC, crossings */
+    SIMTEMP_GENL_ATTR_PID,          /* u32: reader process, overflows */
+    SIMTEMP_GENL_ATTR_LOST,         /* u64: samples lost, overflows */
+
+    __SIMTEMP_GENL_ATTR_MAX,
+};
+#define SIMTEMP_GENL_ATTR_MAX (__SIMTEMP_GENL_ATTR_MAX - 1)
+
+#endif /* _NXP_SIMTEMP_GENL_H */
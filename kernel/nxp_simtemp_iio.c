@@ -0,0 +1,262 @@
+/*
+ * nxp_simtemp_iio.c - IIO front end for nxp_simtemp
+ *
+ * Registers every simtemp instance as an IIO device next to its misc
+ * device, so libiio and iio_readdev can capture it like any other
+ * temperature sensor:
+ *
+ *   cat /sys/bus/iio/devices/iio:deviceX/in_temp_raw
+ *   iio_readdev -b 4096 simtemp temp timestamp > capture.bin
+ *
+ * The device exposes channel 0 of the simulated array plus a timestamp.
+ * Its own trigger fires from the sampling path after every published
+ * period, and the triggered buffer stores that period's value, so the
+ * buffer runs at the generator rate with the IIO kfifo, watermark and
+ * multi-buffer machinery on top.
+ */
+
+#include <linux/kernel.h>
+#include <linux/irq_work.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "nxp_simtemp.h"
+
+struct simtemp_iio {
+    struct simtemp_device *dev;
+    struct iio_trigger *trig;
+    struct irq_work work;       /* Fires the trigger in hard-IRQ context */
+    s32 temp_mC;                /* Channel 0 of the latest period */
+    bool valid;                 /* temp_mC holds a sample */
+};
+
+static const struct iio_chan_spec simtemp_iio_channels[] = {
+    {
+        .type = IIO_TEMP,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |
+                              BIT(IIO_CHAN_INFO_SCALE) |
+                              BIT(IIO_CHAN_INFO_OFFSET),
+        .scan_index = 0,
+        .scan_type = {
+            .sign = 's',
+            .realbits = 32,
+            .storagebits = 32,
+            .endianness = IIO_CPU,
+        },
+    },
+    IIO_CHAN_SOFT_TIMESTAMP(1),
+};
+
+static int simtemp_iio_read_raw(struct iio_dev *indio_dev,
+                                struct iio_chan_spec const *chan,
+                                int *val, int *val2, long mask)
+{
+    struct simtemp_iio *iio = iio_priv(indio_dev);
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        /* Generation only runs while someone consumes samples */
+        if (!READ_ONCE(iio->valid))
+            return -ENODATA;
+        *val = READ_ONCE(iio->temp_mC);
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        /* Raw values already are milli degrees Celsius */
+        *val = 1;
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_OFFSET:
+        *val = 0;
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct iio_info simtemp_iio_info = {
+    .read_raw = simtemp_iio_read_raw,
+};
+
+/* The enabled buffer is a consumer of the stream like an open file */
+static int simtemp_iio_postenable(struct iio_dev *indio_dev)
+{
+    struct simtemp_iio *iio = iio_priv(indio_dev);
+    struct simtemp_device *dev = iio->dev;
+    int ret;
+
+    mutex_lock(&dev->gen_lock);
+    ret = dev->dead ? -ENODEV : simtemp_session_get(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return ret;
+}
+
+static int simtemp_iio_predisable(struct iio_dev *indio_dev)
+{
+    struct simtemp_iio *iio = iio_priv(indio_dev);
+    struct simtemp_device *dev = iio->dev;
+
+    mutex_lock(&dev->gen_lock);
+    simtemp_session_put(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return 0;
+}
+
+static const struct iio_buffer_setup_ops simtemp_iio_buffer_ops = {
+    .postenable = simtemp_iio_postenable,
+    .predisable = simtemp_iio_predisable,
+};
+
+static irqreturn_t simtemp_iio_trigger_handler(int irq, void *p)
+{
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct simtemp_iio *iio = iio_priv(indio_dev);
+    struct {
+        s32 temp_mC;
+        s64 timestamp __aligned(8);
+    } scan = { };
+
+    scan.temp_mC = READ_ONCE(iio->temp_mC);
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan, pf->timestamp);
+    iio_trigger_notify_done(indio_dev->trig);
+
+    return IRQ_HANDLED;
+}
+
+static void simtemp_iio_work(struct irq_work *work)
+{
+    struct simtemp_iio *iio = container_of(work, struct simtemp_iio, work);
+
+    iio_trigger_poll(iio->trig);
+}
+
+/**
+ * simtemp_iio_push - Hand a new period to the IIO front end
+ * @dev: Device structure
+ * @temp_mC: Channel 0 value of the period
+ *
+ * Called from simtemp_publish() in any generation context. The trigger
+ * must be polled from hard-IRQ context, so it is fired through an
+ * irq_work, like the sysfs trigger does.
+ */
+void simtemp_iio_push(struct simtemp_device *dev, s32 temp_mC)
+{
+    struct simtemp_iio *iio;
+
+    if (!dev->iio)
+        return;
+
+    iio = iio_priv(dev->iio);
+    WRITE_ONCE(iio->temp_mC, temp_mC);
+    WRITE_ONCE(iio->valid, true);
+
+    if (iio_buffer_enabled(dev->iio))
+        irq_work_queue(&iio->work);
+}
+
+/**
+ * simtemp_iio_init - Register the IIO device of an instance
+ * @dev: Device structure, fully probed except for the IIO side
+ *
+ * Returns: 0 on success, negative errno on failure
+ */
+int simtemp_iio_init(struct simtemp_device *dev)
+{
+    struct device *parent = &dev->pdev->dev;
+    struct iio_dev *indio_dev;
+    struct simtemp_iio *iio;
+    int ret;
+
+    indio_dev = iio_device_alloc(parent, sizeof(*iio));
+    if (!indio_dev)
+        return -ENOMEM;
+
+    iio = iio_priv(indio_dev);
+    iio->dev = dev;
+    iio->work = IRQ_WORK_INIT_HARD(simtemp_iio_work);
+
+    indio_dev->name = DEVICE_NAME;
+    indio_dev->info = &simtemp_iio_info;
+    indio_dev->channels = simtemp_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(simtemp_iio_channels);
+    indio_dev->modes = INDIO_DIRECT_MODE;
+
+    iio->trig = iio_trigger_alloc(parent, "%s-dev%d", indio_dev->name,
+                                  iio_device_id(indio_dev));
+    if (!iio->trig) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+    iio_trigger_set_drvdata(iio->trig, indio_dev);
+
+    ret = iio_trigger_register(iio->trig);
+    if (ret)
+        goto err_trig_free;
+    indio_dev->trig = iio_trigger_get(iio->trig);
+
+    ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+                                     simtemp_iio_trigger_handler,
+                                     &simtemp_iio_buffer_ops);
+    if (ret)
+        goto err_trig_unregister;
+
+    ret = iio_device_register(indio_dev);
+    if (ret)
+        goto err_buffer;
+
+    dev->iio = indio_dev;
+    return 0;
+
+err_buffer:
+    iio_triggered_buffer_cleanup(indio_dev);
+err_trig_unregister:
+    iio_trigger_unregister(iio->trig);
+err_trig_free:
+    iio_trigger_free(iio->trig);
+err_free:
+    iio_device_free(indio_dev);
+    return ret;
+}
+
+/**
+ * simtemp_iio_exit - Unregister the IIO device of an instance
+ * @dev: Device structure
+ *
+ * Disables a running buffer, which ends its session. The structures
+ * stay allocated until simtemp_iio_free(), because the sampling path
+ * may still look at dev->iio until generation has stopped.
+ */
+void simtemp_iio_exit(struct simtemp_device *dev)
+{
+    struct simtemp_iio *iio;
+
+    if (!dev->iio)
+        return;
+
+    iio = iio_priv(dev->iio);
+    iio_device_unregister(dev->iio);
+    irq_work_sync(&iio->work);
+    iio_triggered_buffer_cleanup(dev->iio);
+    iio_trigger_unregister(iio->trig);
+}
+
+/* Last reference to the device is gone, generation has stopped */
+void simtemp_iio_free(struct simtemp_device *dev)
+{
+    struct iio_trigger *trig;
+    struct simtemp_iio *iio;
+
+    if (!dev->iio)
+        return;
+
+    iio = iio_priv(dev->iio);
+    irq_work_sync(&iio->work);
+    trig = iio->trig;
+    iio_device_free(dev->iio);
+    iio_trigger_free(trig);
+    dev->iio = NULL;
+}
@@ -0,0 +1,165 @@
+/*
+ * nxp_simtemp_ioctl.h - NXP Simulated Temperature Sensor user space ABI
+ *
+ * Shared between the driver and user space programs. Only fixed-size
+ * types are used so the layout is identical for 32 and 64-bit callers.
+ */
+
+#ifndef _NXP_SIMTEMP_IOCTL_H
+#define _NXP_SIMTEMP_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Sample flags */
+#define SIMTEMP_FLAG_NEW_SAMPLE         0x01
+#define SIMTEMP_FLAG_THRESHOLD_EXCEEDED 0x02
+#define SIMTEMP_FLAG_RATE_CHANGE        0x04  /* First period at a new rate */
+
+/* Sample structure returned by read() */
+struct simtemp_sample {
+    __u64 timestamp_ns;
+    __s32 temp_mC;
+    __u32 flags;
+} __attribute__((packed));
+
+/*
+ * Extended sample, returned by read() on files set to SIMTEMP_FORMAT_V2.
+ * Devices simulating several channels deliver every channel of a period
+ * with the same timestamp, ordered by timestamp, then channel.
+ */
+struct simtemp_sample_v2 {
+    __u64 timestamp_ns; /* Clock selected with SIMTEMP_IOC_SET_CLOCK */
+    __u64 wall_ns;      /* CLOCK_REALTIME, converted at generation */
+    __s32 temp_mC;
+    __u32 flags;
+    __u32 channel;      /* 0 .. channels - 1 */
+    __u32 seq;          /* Sample period, low 32 bits */
+};
+
+/*
+ * Replay trace, loaded with request_firmware() through
+ * /sys/class/misc/simtemp/replay/firmware: this header followed by
+ * count struct simtemp_sample records in host byte order. write() to
+ * the device accepts the same records without the header.
+ */
+#define SIMTEMP_TRACE_MAGIC     0x43525453  /* "STRC" */
+#define SIMTEMP_TRACE_VERSION   1
+
+struct simtemp_trace_header {
+    __u32 magic;
+    __u32 version;
+    __u32 count;
+    __u32 reserved;
+};
+
+/* Driver counters, summed over all CPUs */
+struct simtemp_counters {
+    __u64 generated;         /* Samples produced by the generator */
+    __u64 delivered;         /* Samples copied to user space */
+    __u64 overwritten;       /* Samples dropped by a full ring, once each */
+    __u64 read_eagain;       /* read() calls that returned -EAGAIN */
+    __u64 spurious_wakeups;  /* Blocking reads woken with nothing to read */
+    __u64 poll_calls;        /* poll()/select() invocations */
+    __u64 lock_contended;    /* Ring lock acquisitions that had to spin */
+};
+
+/* Per open file delivery settings */
+struct simtemp_reader_config {
+    __u32 filter;       /* Only deliver samples with all these flags set */
+    __u32 decimation;   /* Deliver one sample out of N (N >= 1) */
+    __u32 watermark;    /* Wake readers/poll once N samples are pending */
+    __u32 format;       /* SIMTEMP_FORMAT_*, record layout of read() */
+};
+
+/* Record formats */
+#define SIMTEMP_FORMAT_V1   0   /* struct simtemp_sample */
+#define SIMTEMP_FORMAT_V2   1   /* struct simtemp_sample_v2 */
+#define SIMTEMP_FORMAT_DELTA 2  /* struct simtemp_delta_batch + deltas */
+
+/*
+ * Compact batches, returned by read() on files set to
+ * SIMTEMP_FORMAT_DELTA. Each batch is this header followed by bytes of
+ * payload, count samples of four LEB128 varints each:
+ *
+ *   flags
+ *   zigzag(channel - (previous channel + 1))
+ *   zigzag(timestamp_ns - previous timestamp_ns - step)
+ *   zigzag(temp_mC - previous temp_mC)
+ *
+ * where zigzag(x) = (x << 1) ^ (x >> 63), and step is period_ns when
+ * the sample's channel is not above the previous one (a new period
+ * starts), 0 otherwise. Before the first sample, the previous channel
+ * is -1, the previous timestamp base_ns and the previous temperature 0.
+ * One read() may return several batches back to back, so headers are
+ * not necessarily aligned. wall_ns and seq are not transported.
+ */
+struct simtemp_delta_batch {
+    __u64 base_ns;      /* timestamp_ns of the first sample */
+    __u64 period_ns;    /* Timestamp step between periods in this batch */
+    __u32 count;        /* Samples in the batch */
+    __u32 bytes;        /* Payload size following the header */
+};
+
+/* Worst case payload per sample, size read() buffers with it */
+#define SIMTEMP_DELTA_MAX_SAMPLE 25
+
+/* Latest value of one channel, see SIMTEMP_IOC_GET_SNAPSHOT */
+struct simtemp_channel_value {
+    __s32 temp_mC;
+    __u32 flags;
+    __u32 channel;
+};
+
+/* Consistent view of the latest period of every (selected) channel */
+struct simtemp_snapshot {
+    __u64 values_ptr;   /* In: struct simtemp_channel_value array */
+    __u64 mask_ptr;     /* In: __u64 channel bitmap, 0 = all channels */
+    __u32 nr_channels;  /* In: capacity of values_ptr, out: entries */
+    __u32 reserved;     /* Must be zero */
+    __u64 timestamp_ns; /* Out: timestamp of the period */
+    __u64 generation;   /* Out: periods published so far */
+};
+
+/* Hottest channels of the latest period, see SIMTEMP_IOC_GET_TOPK */
+#define SIMTEMP_TOPK_MAX 16
+
+struct simtemp_topk {
+    __u32 k;            /* In: 1..SIMTEMP_TOPK_MAX, out: entries */
+    __u32 reserved;     /* Must be zero */
+    __u64 timestamp_ns; /* Out: timestamp of the period */
+    __u64 generation;   /* Out: periods published so far */
+    struct simtemp_channel_value values[SIMTEMP_TOPK_MAX]; /* Hottest first */
+};
+
+#define SIMTEMP_IOC_MAGIC 'S'
+
+/* Read the driver counters */
+#define SIMTEMP_IOC_GET_COUNTERS _IOR(SIMTEMP_IOC_MAGIC, 3, struct simtemp_counters)
+
+/* Change or read the delivery settings of this open file */
+#define SIMTEMP_IOC_SET_READER_CONFIG _IOW(SIMTEMP_IOC_MAGIC, 5, struct simtemp_reader_config)
+#define SIMTEMP_IOC_GET_READER_CONFIG _IOR(SIMTEMP_IOC_MAGIC, 6, struct simtemp_reader_config)
+
+/*
+ * Clock of timestamp_ns in read() records of this open file: a clockid
+ * of CLOCK_MONOTONIC (default), CLOCK_REALTIME, CLOCK_BOOTTIME or
+ * CLOCK_TAI. Snapshot and top-K timestamps stay CLOCK_MONOTONIC.
+ */
+#define SIMTEMP_IOC_SET_CLOCK _IOW(SIMTEMP_IOC_MAGIC, 9, __u32)
+#define SIMTEMP_IOC_GET_CLOCK _IOR(SIMTEMP_IOC_MAGIC, 10, __u32)
+
+/*
+ * Signal an eventfd when this file reaches its watermark, and when the
+ * threshold is crossed upwards. The argument is the eventfd, -1 removes
+ * it. fcntl(F_SETFL, O_ASYNC) delivers SIGIO on the same events.
+ */
+#define SIMTEMP_IOC_SET_EVENTFD _IOW(SIMTEMP_IOC_MAGIC, 11, __s32)
+
+/* Latest values of all channels, or of those in mask_ptr, in one copy */
+#define SIMTEMP_IOC_GET_SNAPSHOT _IOWR(SIMTEMP_IOC_MAGIC, 7, struct simtemp_snapshot)
+
+/* The k hottest channels, maintained by the driver as samples are made */
+#define SIMTEMP_IOC_GET_TOPK _IOWR(SIMTEMP_IOC_MAGIC, 8, struct simtemp_topk)
+
+#endif /* _NXP_SIMTEMP_IOCTL_H */
@@ -0,0 +1,2624 @@
+/*
+ * nxp_simtemp_main.c - NXP Simulated Temperature Sensor Driver
+ * 
+ * This driver simulates a temperature sensor for the NXP Systems
+ * Software Engineer Challenge.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/platform_device.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/of.h>
+#include <linux/random.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/idr.h>
+#include <linux/math64.h>
+#include <linux/cpumask.h>
+#include <linux/cpu.h>
+#include <linux/smp.h>
+#include <linux/log2.h>
+#include <linux/workqueue.h>
+#include <linux/bitmap.h>
+#include <linux/timekeeping.h>
+#include <linux/eventfd.h>
+#include <kunit/visibility.h>
+
+#include "nxp_simtemp.h"
+#include "nxp_simtemp_genl.h"
+
+#define CREATE_TRACE_POINTS
+#include "nxp_simtemp_trace.h"
+
+/* Instance numbers: 0 is /dev/simtemp, N is /dev/simtempN */
+static DEFINE_IDA(simtemp_ida);
+
+/* Runs the shards of large channel sets, bound to the shard CPUs */
+static struct workqueue_struct *simtemp_wq;
+
+static unsigned int nr_instances = 1;
+module_param(nr_instances, uint, 0444);
+MODULE_PARM_DESC(nr_instances, "Simulated sensors to create without Device Tree (default 1)");
+
+/*
+ * Temperature generation logic
+ */
+
+/**
+ * simtemp_generate_sample - Generate a simulated temperature sample
+ * @dev: Device structure
+ * @sample: Output sample structure
+ * @timestamp_ns: CLOCK_MONOTONIC time the sample represents
+ * @wall_ns: Same instant in CLOCK_REALTIME
+ * @channel: Channel the sample belongs to
+ * @phase: Waveform phase of the channel in this period
+ * 
+ * Generates a realistic temperature value with random variation
+ * or from the waveform profile and checks against threshold.
+ */
+VISIBLE_IF_KUNIT void simtemp_generate_sample(struct simtemp_device *dev,
+                                              struct simtemp_sample_v2 *sample,
+                                              u64 timestamp_ns, u64 wall_ns,
+                                              u32 channel, u32 phase)
+{
+    sample->timestamp_ns = timestamp_ns;
+    sample->wall_ns = wall_ns;
+    sample->channel = channel;
+    sample->seq = (u32)dev->tick_seq;
+
+    if (dev->source == SIMTEMP_SRC_REPLAY) {
+        /* Recorded value, flags are recomputed below */
+        sample->temp_mC = READ_ONCE(dev->replay.temp_mC);
+    } else if (READ_ONCE(dev->wave.profile) != SIMTEMP_PROFILE_NOISE) {
+        sample->temp_mC = dev->base_temp_mC +
+                          simtemp_wave_value(&dev->wave, phase);
+    } else {
+        /* Random variation: [-temp_variation_mC, +temp_variation_mC] */
+        sample->temp_mC = simtemp_core_noise(dev->base_temp_mC,
+                                             dev->temp_variation_mC,
+                                             get_random_u32());
+    }
+
+    /* Flags, with the threshold check */
+    sample->flags = simtemp_core_flags(sample->temp_mC, dev->threshold_mC,
+                                       dev->period_flags);
+
+    trace_simtemp_generate(dev->mdev.name, sample->timestamp_ns,
+                           sample->temp_mC, sample->flags);
+}
+
+/* Samples of period @seq of a shard, valid until period @seq + 2 starts */
+static struct simtemp_sample_v2 *simtemp_shard_period(struct simtemp_shard *shard,
+                                                      u64 seq)
+{
+    return shard->periods + (seq & 1) * shard->nr_channels;
+}
+
+/*
+ * Top-K heap helpers
+ *
+ * A bounded min-heap keeps the @cap hottest values seen so far: a new
+ * value only has to beat the root, which makes the common case (not
+ * among the hottest) a single compare.
+ */
+
+static void simtemp_topk_sift_down(struct simtemp_topk_heap *heap, u32 i)
+{
+    u32 child;
+
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= heap->nr)
+            break;
+        if (child + 1 < heap->nr &&
+            heap->v[child + 1].temp_mC < heap->v[child].temp_mC)
+            child++;
+        if (heap->v[i].temp_mC <= heap->v[child].temp_mC)
+            break;
+        swap(heap->v[i], heap->v[child]);
+        i = child;
+    }
+}
+
+static void simtemp_topk_push(struct simtemp_topk_heap *heap, u32 cap,
+                              const struct simtemp_channel_value *val)
+{
+    u32 i, parent;
+
+    if (heap->nr < cap) {
+        /* Not full yet: append and sift up */
+        i = heap->nr++;
+        heap->v[i] = *val;
+        while (i) {
+            parent = (i - 1) / 2;
+            if (heap->v[parent].temp_mC <= heap->v[i].temp_mC)
+                break;
+            swap(heap->v[parent], heap->v[i]);
+            i = parent;
+        }
+    } else if (val->temp_mC > heap->v[0].temp_mC) {
+        /* Evict the coolest */
+        heap->v[0] = *val;
+        simtemp_topk_sift_down(heap, 0);
+    }
+}
+
+/* Empty @heap into @out, hottest first */
+static u32 simtemp_topk_drain(struct simtemp_topk_heap *heap,
+                              struct simtemp_channel_value *out)
+{
+    u32 n = heap->nr;
+
+    while (heap->nr) {
+        out[heap->nr - 1] = heap->v[0];
+        heap->v[0] = heap->v[--heap->nr];
+        simtemp_topk_sift_down(heap, 0);
+    }
+
+    return n;
+}
+
+/**
+ * simtemp_shard_generate - Produce one period of a shard's channels
+ * @shard: Shard
+ * @timestamp_ns: Timestamp of the period
+ * 
+ * The samples stay invisible to readers until simtemp_publish(). They
+ * are kept after the ring put, with the shard's top-K, as the latest
+ * values for snapshots.
+ */
+static void simtemp_shard_generate(struct simtemp_shard *shard,
+                                   u64 timestamp_ns)
+{
+    struct simtemp_device *dev = shard->dev;
+    struct simtemp_sample_v2 *period = simtemp_shard_period(shard,
+                                                            dev->tick_seq);
+    struct simtemp_topk_heap *topk = &shard->topk[dev->tick_seq & 1];
+    struct simtemp_channel_value val;
+    u32 i, phase, seen = 0;
+    u64 head, wall_ns;
+
+    /*
+     * This buffer held period tick_seq - 2. Snapshot readers must see
+     * the tick_seq update that retired it before any of our stores.
+     */
+    smp_wmb();
+
+    /* Wall clock once per period, so no reader converts per sample */
+    wall_ns = ktime_to_ns(ktime_mono_to_real(ns_to_ktime(timestamp_ns)));
+
+    /* DDS: the period's phase, then a fixed offset from channel to channel */
+    phase = (u32)dev->tick_seq * READ_ONCE(dev->wave.phase_inc) +
+            shard->first_channel * SIMTEMP_WAVE_SPREAD;
+
+    /* The shard's hottest channels are ranked as they are generated */
+    topk->nr = 0;
+    for (i = 0; i < shard->nr_channels; i++, phase += SIMTEMP_WAVE_SPREAD) {
+        simtemp_generate_sample(dev, &period[i], timestamp_ns, wall_ns,
+                                shard->first_channel + i, phase);
+        seen |= period[i].flags;
+        val.temp_mC = period[i].temp_mC;
+        val.flags = period[i].flags;
+        val.channel = period[i].channel;
+        simtemp_topk_push(topk, SIMTEMP_TOPK_MAX, &val);
+    }
+    shard->flags_seen = seen;
+    this_cpu_add(dev->counters->generated, shard->nr_channels);
+
+    head = ring_buffer_put(&shard->ring, period, shard->nr_channels);
+    shard->put_head = head;
+    simtemp_relay_write(dev, period, shard->nr_channels);
+    trace_simtemp_enqueue(dev->mdev.name, timestamp_ns,
+                          head - shard->nr_channels, head);
+}
+
+/*
+ * Timer callback
+ */
+
+/* Sum of the published ring heads of all shards */
+static u64 simtemp_published(struct simtemp_device *dev)
+{
+    u64 head = 0;
+    unsigned int k;
+
+    for (k = 0; k < dev->nr_shards; k++)
+        head += READ_ONCE(dev->shards[k].published);
+
+    return head;
+}
+
+/* Published samples a reader has not consumed yet, over all shards */
+static u64 simtemp_reader_lag(struct simtemp_reader *reader)
+{
+    struct simtemp_device *dev = reader->dev;
+    u64 lag = 0;
+    unsigned int k;
+
+    for (k = 0; k < dev->nr_shards; k++)
+        lag += min_t(u64, READ_ONCE(dev->shards[k].published) -
+                          READ_ONCE(reader->cursors[k]),
+                     dev->shards[k].ring.size);
+
+    return lag;
+}
+
+/* Ring position of a reader, summed like simtemp_published() */
+static u64 simtemp_reader_pos(struct simtemp_reader *reader)
+{
+    u64 pos = 0;
+    unsigned int k;
+
+    for (k = 0; k < reader->dev->nr_shards; k++)
+        pos += READ_ONCE(reader->cursors[k]);
+
+    return pos;
+}
+
+/* Raise the eventfd and SIGIO of a reader, any context, under RCU */
+static void simtemp_reader_notify(struct simtemp_reader *reader)
+{
+    struct eventfd_ctx *ctx = rcu_dereference(reader->eventfd);
+
+    if (ctx)
+        eventfd_signal(ctx);
+    kill_fasync(&reader->fasync, SIGIO, POLL_IN);
+}
+
+/**
+ * simtemp_scan_readers - Inspect every open file after a new period
+ * @dev: Device structure
+ * @max_lag: Receives the backlog of the slowest reader
+ * @min_lag: Receives the backlog of the fastest reader, 0 if none
+ * @alert: The period crossed the threshold upwards
+ * 
+ * Async notification is edge triggered: once when a reader reaches its
+ * watermark, again only after it drained below, plus on every @alert.
+ * Only this function touches reader->notified, so no lock is needed.
+ * 
+ * Returns: true if at least one reader reached its watermark
+ */
+static bool simtemp_scan_readers(struct simtemp_device *dev, u64 *max_lag,
+                                 u64 *min_lag, bool alert)
+{
+    struct simtemp_reader *reader;
+    bool wake = false, notify;
+
+    *max_lag = 0;
+    *min_lag = U64_MAX;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(reader, &dev->readers, node) {
+        u64 lag = simtemp_reader_lag(reader);
+
+        *max_lag = max(*max_lag, lag);
+        *min_lag = min(*min_lag, lag);
+        notify = alert;
+        if (lag >= READ_ONCE(reader->watermark)) {
+            wake = true;
+            notify |= !reader->notified;
+            reader->notified = true;
+        } else {
+            reader->notified = false;
+        }
+        if (notify)
+            simtemp_reader_notify(reader);
+    }
+    rcu_read_unlock();
+
+    if (*min_lag == U64_MAX)
+        *min_lag = 0;
+
+    return wake;
+}
+
+/**
+ * simtemp_adapt_rate - Follow the backpressure of the readers
+ * @dev: Device structure
+ * @min_lag: Backlog of the fastest reader, in samples
+ * 
+ * Once even the fastest reader is more than adaptive_lag periods
+ * behind, the rate is halved, down to 1/2^SIMTEMP_RATE_SHIFT_MAX. It
+ * doubles again when that reader is back within half of the limit.
+ * Every change is flagged on the next generated period, so consumers
+ * see where the sample interval changes instead of random overwrites.
+ * The timer and the thread are re-armed at the period times the
+ * divider, so a lower rate also means fewer wakeups.
+ */
+static void simtemp_adapt_rate(struct simtemp_device *dev, u64 min_lag)
+{
+    u32 limit = READ_ONCE(dev->adaptive_lag);
+    u32 shift = dev->rate_shift;
+    u64 periods = div_u64(min_lag, dev->num_channels);
+
+    if (limit && periods > limit && shift < SIMTEMP_RATE_SHIFT_MAX)
+        shift++;
+    else if (shift && (!limit || periods <= limit / 2))
+        shift--;
+    else
+        return;
+
+    WRITE_ONCE(dev->rate_shift, shift);
+    WRITE_ONCE(dev->rate_changed, true);
+}
+
+/**
+ * simtemp_publish - Make one complete period visible to readers
+ * @dev: Device structure
+ * @timestamp_ns: Timestamp of the period
+ * 
+ * Called once every shard has stored its samples of the period. The
+ * per-shard heads are published before the period timestamp, so a
+ * reader that sees the timestamp finds every shard's samples in place.
+ */
+static void simtemp_publish(struct simtemp_device *dev, u64 timestamp_ns)
+{
+    u64 head, max_lag, min_lag, seq = dev->tick_seq;
+    bool exceeded = false, alert;
+    unsigned int k;
+    s32 temp_mC;
+
+    for (k = 0; k < dev->nr_shards; k++) {
+        WRITE_ONCE(dev->shards[k].published, dev->shards[k].put_head);
+        if (dev->shards[k].flags_seen & SIMTEMP_FLAG_THRESHOLD_EXCEEDED)
+            exceeded = true;
+    }
+    smp_store_release(&dev->published_ns, timestamp_ns);
+    smp_store_release(&dev->tick_seq, seq + 1);
+
+    /* The IIO front end and the thermal zone follow channel 0 */
+    temp_mC = simtemp_shard_period(&dev->shards[0], seq)->temp_mC;
+    simtemp_iio_push(dev, temp_mC);
+    simtemp_thermal_push(dev, temp_mC);
+
+    /* Some channel went over the threshold with this period */
+    alert = exceeded && !dev->exceeded;
+    if (exceeded != dev->exceeded) {
+        struct simtemp_event ev = {
+            .type = exceeded ? SIMTEMP_GENL_EVENT_THRESHOLD_UP :
+                               SIMTEMP_GENL_EVENT_THRESHOLD_DOWN,
+            .threshold_mC = READ_ONCE(dev->threshold_mC),
+            .timestamp_ns = timestamp_ns,
+        };
+
+        simtemp_genl_notify(dev, &ev);
+    }
+    dev->exceeded = exceeded;
+
+    /* Wake up readers that reached their watermark */
+    if (simtemp_scan_readers(dev, &max_lag, &min_lag, alert)) {
+        head = simtemp_published(dev);
+        trace_simtemp_wakeup(dev->mdev.name, timestamp_ns, head - 1, head);
+        /* Backlog as the woken readers find it, not of every period */
+        simtemp_hist_record(&dev->stats.ring_occupancy, max_lag);
+        wake_up_interruptible(&dev->wait_queue);
+    }
+    simtemp_adapt_rate(dev, min_lag);
+}
+
+/**
+ * simtemp_shard_work - Generate a shard on its own CPU
+ * @work: Shard work item
+ * 
+ * The last shard to finish publishes the period, then releases the
+ * device for the next tick.
+ */
+static void simtemp_shard_work(struct work_struct *work)
+{
+    struct simtemp_shard *shard = container_of(work, struct simtemp_shard,
+                                               work);
+    struct simtemp_device *dev = shard->dev;
+
+    simtemp_shard_generate(shard, dev->tick_ns);
+
+    if (atomic_dec_return(&dev->shards_busy) == 1) {
+        simtemp_publish(dev, dev->tick_ns);
+        atomic_set_release(&dev->shards_busy, 0);
+    }
+}
+
+/* Latch the rate change flag for the period about to be generated */
+static void simtemp_period_begin(struct simtemp_device *dev)
+{
+    dev->period_flags = 0;
+    if (READ_ONCE(dev->rate_changed)) {
+        WRITE_ONCE(dev->rate_changed, false);
+        dev->period_flags = SIMTEMP_FLAG_RATE_CHANGE;
+    }
+}
+
+/* Distance to the next tick: the period times the adaptive rate divider */
+static ktime_t simtemp_tick_interval(struct simtemp_device *dev)
+{
+    return ns_to_ktime(ktime_to_ns(dev->timer_interval) <<
+                       READ_ONCE(dev->rate_shift));
+}
+
+/**
+ * simtemp_tick - Produce one sample period
+ * @dev: Device structure
+ * @expires: Time this period was due
+ * 
+ * Shared by every generation context (hard/soft hrtimer, kthread) and
+ * the replay thread.
+ * A single shard is generated right here; larger channel sets are
+ * handed to one work item per shard and generated in parallel.
+ */
+void simtemp_tick(struct simtemp_device *dev, ktime_t expires)
+{
+    u64 timestamp_ns;
+    unsigned int k;
+    ktime_t start;
+
+    /* How late did we run compared to the programmed expiry? */
+    start = ktime_get();
+    simtemp_hist_record(&dev->stats.timer_lateness,
+                        ktime_to_ns(ktime_sub(start, expires)));
+
+    /*
+     * Aligned instances stamp the period boundary itself, so every
+     * sensor sharing the period reports the identical timestamp.
+     */
+    timestamp_ns = dev->align ? ktime_to_ns(expires) : ktime_to_ns(start);
+
+    if (dev->nr_shards == 1) {
+        simtemp_period_begin(dev);
+        simtemp_shard_generate(&dev->shards[0], timestamp_ns);
+        simtemp_publish(dev, timestamp_ns);
+    } else if (!atomic_read_acquire(&dev->shards_busy)) {
+        simtemp_period_begin(dev);
+        /* One extra count is dropped by the shard that publishes */
+        dev->tick_ns = timestamp_ns;
+        atomic_set(&dev->shards_busy, dev->nr_shards + 1);
+        for (k = 0; k < dev->nr_shards; k++)
+            queue_work_on(READ_ONCE(dev->shards[k].cpu), simtemp_wq,
+                          &dev->shards[k].work);
+    }
+    /* else the previous period is still being generated, skip this one */
+
+    simtemp_hist_record(&dev->stats.callback_duration,
+                        ktime_to_ns(ktime_sub(ktime_get(), start)));
+}
+
+/**
+ * simtemp_timer_callback - High-resolution timer callback
+ * @timer: Timer that expired
+ * 
+ * Called periodically to generate and store temperature samples. Runs
+ * in hard-IRQ or softirq context depending on dev->gen_mode.
+ * 
+ * Returns: HRTIMER_RESTART to continue periodic execution
+ */
+static enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer)
+{
+    struct simtemp_device *dev;
+
+    dev = container_of(timer, struct simtemp_device, timer);
+
+    /* The soft expiry is the period boundary, slack comes on top */
+    simtemp_tick(dev, hrtimer_get_softexpires(timer));
+
+    /* Schedule next timer, slowed down by the adaptive rate divider */
+    hrtimer_forward_now(timer, simtemp_tick_interval(dev));
+
+    return HRTIMER_RESTART;
+}
+
+/**
+ * simtemp_first_expiry - Absolute time of the first tick
+ * @dev: Device structure
+ * 
+ * Aligned instances fire on multiples of their period on the
+ * CLOCK_MONOTONIC timeline, so all instances with the same period
+ * expire together and the hrtimer core handles them in one interrupt.
+ * Once started, hrtimer_forward() keeps that phase.
+ */
+static ktime_t simtemp_first_expiry(struct simtemp_device *dev)
+{
+    u64 period = ktime_to_ns(dev->timer_interval);
+    u64 now = ktime_get_ns();
+
+    if (dev->align)
+        return ns_to_ktime(DIV64_U64_ROUND_UP(now + 1, period) * period);
+
+    return ns_to_ktime(now + period);
+}
+
+/**
+ * simtemp_gen_thread - SCHED_FIFO generation thread
+ * @data: Device structure
+ * 
+ * Sleeps on an absolute hrtimer and runs the tick in process context,
+ * which keeps the work out of interrupt context on PREEMPT_RT.
+ */
+static int simtemp_gen_thread(void *data)
+{
+    struct simtemp_device *dev = data;
+    ktime_t expires = dev->start_expiry;
+    ktime_t now, interval;
+
+    sched_set_fifo(current);
+
+    while (!kthread_should_stop()) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop()) {
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+        schedule_hrtimeout_range(&expires, dev->slack_ns, HRTIMER_MODE_ABS);
+
+        now = ktime_get();
+        if (ktime_before(now, expires))
+            continue; /* Woken early, e.g. by kthread_stop() */
+
+        simtemp_tick(dev, expires);
+
+        /* Skip whole periods we overran, like hrtimer_forward() */
+        interval = simtemp_tick_interval(dev);
+        expires = ktime_add(expires, interval);
+        if (ktime_before(expires, now)) {
+            s64 missed = ktime_divns(ktime_sub(now, expires),
+                                     ktime_to_ns(interval));
+
+            expires = ktime_add_ns(expires, (missed + 1) *
+                                   ktime_to_ns(interval));
+        }
+    }
+
+    return 0;
+}
+
+static const char * const simtemp_gen_mode_names[] = {
+    [SIMTEMP_GEN_HARDIRQ] = "hardirq",
+    [SIMTEMP_GEN_SOFTIRQ] = "softirq",
+    [SIMTEMP_GEN_THREAD] = "thread",
+};
+
+/**
+ * simtemp_preroll - Back-fill the ring before generation starts
+ * @dev: Device structure
+ * 
+ * Produces dev->preroll periods of every channel, the ones right before
+ * dev->start_expiry on the same grid (period boundaries when aligned),
+ * so the first reader of a session gets a warm history window
+ * immediately instead of waiting for the timer to fill the ring.
+ * Caller must hold dev->gen_lock.
+ */
+static void simtemp_preroll(struct simtemp_device *dev)
+{
+    u64 timestamp_ns, first = ktime_to_ns(dev->start_expiry);
+    u32 i, n = dev->preroll;
+    unsigned int k;
+
+    for (i = 0; i < n; i++) {
+        timestamp_ns = first - (u64)(n - i) *
+                       ktime_to_ns(dev->timer_interval);
+        simtemp_period_begin(dev);
+        for (k = 0; k < dev->nr_shards; k++)
+            simtemp_shard_generate(&dev->shards[k], timestamp_ns);
+        simtemp_publish(dev, timestamp_ns);
+    }
+
+    /* Nobody waited for these, keep them out of delivery_latency */
+    WRITE_ONCE(dev->live_seq, (u32)dev->tick_seq);
+}
+
+/* hrtimer mode of the timer based contexts, without placement bits */
+static enum hrtimer_mode simtemp_timer_mode(struct simtemp_device *dev)
+{
+    /*
+     * Plain ABS mode: hard-IRQ expiry, except on PREEMPT_RT where the
+     * hrtimer core moves it to softirq because spinlock_t may sleep.
+     */
+    if (dev->gen_mode == SIMTEMP_GEN_SOFTIRQ)
+        return HRTIMER_MODE_ABS_SOFT;
+    return HRTIMER_MODE_ABS;
+}
+
+struct simtemp_timer_arm {
+    struct simtemp_device *dev;
+    ktime_t expires;
+};
+
+/* Runs on the target CPU, the timer is queued on the local clock base */
+static void simtemp_timer_arm_local(void *info)
+{
+    struct simtemp_timer_arm *arm = info;
+    struct simtemp_device *dev = arm->dev;
+
+    hrtimer_start_range_ns(&dev->timer, arm->expires, dev->slack_ns,
+                           simtemp_timer_mode(dev) | HRTIMER_MODE_PINNED);
+}
+
+/**
+ * simtemp_timer_arm - Queue the sampling timer on an allowed CPU
+ * @dev: Device structure
+ * @expires: Absolute expiry
+ * 
+ * An hrtimer is queued on the CPU that starts it, so with a restricted
+ * gen_cpus mask the start is sent to the first online CPU of the mask and
+ * the timer is pinned there (no NOHZ migration to other idle CPUs). It
+ * stays on that CPU, re-arming itself from the callback, until it is
+ * cancelled or the CPU goes offline, in which case the hrtimer core moves
+ * it to a surviving CPU.
+ */
+static void simtemp_timer_arm(struct simtemp_device *dev, ktime_t expires)
+{
+    struct simtemp_timer_arm arm = { .dev = dev, .expires = expires };
+    unsigned int cpu;
+
+    if (cpumask_subset(cpu_possible_mask, &dev->gen_cpus)) {
+        hrtimer_start_range_ns(&dev->timer, expires, dev->slack_ns,
+                               simtemp_timer_mode(dev));
+        return;
+    }
+
+    cpus_read_lock();
+    cpu = cpumask_first_and(&dev->gen_cpus, cpu_online_mask);
+    if (cpu >= nr_cpu_ids ||
+        smp_call_function_single(cpu, simtemp_timer_arm_local, &arm, 1))
+        hrtimer_start_range_ns(&dev->timer, expires, dev->slack_ns,
+                               simtemp_timer_mode(dev));
+    cpus_read_unlock();
+}
+
+static void simtemp_shards_free(struct simtemp_shard *shards, unsigned int nr)
+{
+    unsigned int k;
+
+    for (k = 0; k < nr; k++) {
+        kvfree(shards[k].samples);
+        kvfree(shards[k].periods);
+    }
+    kfree(shards);
+}
+
+/**
+ * simtemp_shards_alloc - Split the channels into shards
+ * @dev: Device structure
+ * @channels: Number of channels to simulate
+ * 
+ * Every SIMTEMP_SHARD_CHANNELS channels get their own shard, up to one
+ * per possible CPU. Each shard owns a ring segment deep enough for
+ * RING_BUFFER_SIZE periods of its channels. On success the new layout
+ * replaces dev->shards, the caller frees the old one. Generation must be
+ * stopped.
+ * 
+ * Returns: 0 on success, -ENOMEM on allocation failure
+ */
+static int simtemp_shards_alloc(struct simtemp_device *dev, u32 channels)
+{
+    struct simtemp_shard *shards, *shard;
+    unsigned int nr, k;
+    u32 per, size;
+
+    nr = clamp_t(unsigned int, DIV_ROUND_UP(channels, SIMTEMP_SHARD_CHANNELS),
+                 1, num_possible_cpus());
+    per = DIV_ROUND_UP(channels, nr);
+
+    shards = kcalloc(nr, sizeof(*shards), GFP_KERNEL);
+    if (!shards)
+        return -ENOMEM;
+
+    for (k = 0; k < nr; k++) {
+        shard = &shards[k];
+        shard->dev = dev;
+        shard->first_channel = k * per;
+        shard->nr_channels = min(per, channels - shard->first_channel);
+        shard->cpu = WORK_CPU_UNBOUND;
+        INIT_WORK(&shard->work, simtemp_shard_work);
+
+        size = roundup_pow_of_two(shard->nr_channels * RING_BUFFER_SIZE);
+        shard->periods = kvcalloc(2 * shard->nr_channels,
+                                  sizeof(*shard->periods), GFP_KERNEL);
+        shard->samples = kvcalloc(size, sizeof(*shard->samples), GFP_KERNEL);
+        if (!shard->periods || !shard->samples)
+            goto err;
+        ring_buffer_init(&shard->ring, shard->samples, size, dev->counters);
+    }
+
+    dev->shards = shards;
+    dev->nr_shards = nr;
+    dev->num_channels = channels;
+    dev->tick_seq = 0; /* No period of the new layout published yet */
+    return 0;
+
+err:
+    simtemp_shards_free(shards, nr);
+    return -ENOMEM;
+}
+
+/*
+ * Spread the shard work items round-robin over the online CPUs of
+ * dev->gen_cpus. Caller must hold dev->gen_lock.
+ */
+static void simtemp_shards_place(struct simtemp_device *dev)
+{
+    unsigned int k;
+    int cpu = -1;
+
+    if (dev->nr_shards == 1)
+        return;
+
+    cpus_read_lock();
+    for (k = 0; k < dev->nr_shards; k++) {
+        cpu = cpumask_next_and(cpu, &dev->gen_cpus, cpu_online_mask);
+        if (cpu >= nr_cpu_ids)
+            cpu = cpumask_first_and(&dev->gen_cpus, cpu_online_mask);
+        WRITE_ONCE(dev->shards[k].cpu,
+                   cpu < nr_cpu_ids ? cpu : WORK_CPU_UNBOUND);
+    }
+    cpus_read_unlock();
+}
+
+/**
+ * simtemp_gen_start - Start sample generation in the configured context
+ * @dev: Device structure
+ * 
+ * Caller must hold dev->gen_lock.
+ * 
+ * Returns: 0 on success, negative errno if the thread cannot be created
+ */
+static int simtemp_gen_start(struct simtemp_device *dev)
+{
+    struct task_struct *task;
+    int ret;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (dev->gen_running)
+        return 0;
+
+    simtemp_shards_place(dev);
+
+    /* Fixed earlier by simtemp_session_get() for the pre-roll */
+    if (!dev->start_expiry)
+        dev->start_expiry = simtemp_first_expiry(dev);
+
+    if (dev->source == SIMTEMP_SRC_REPLAY) {
+        /* The replay thread paces itself, gen_mode does not apply */
+        ret = simtemp_replay_start(dev);
+        if (ret)
+            return ret;
+        dev->gen_running = true;
+        pr_info("simtemp: Replay started\n");
+        return 0;
+    }
+
+    switch (dev->gen_mode) {
+    case SIMTEMP_GEN_THREAD:
+        task = kthread_create(simtemp_gen_thread, dev, "simtemp/%s",
+                              dev_name(&dev->pdev->dev));
+        if (IS_ERR(task))
+            return PTR_ERR(task);
+        set_cpus_allowed_ptr(task, &dev->gen_cpus);
+        wake_up_process(task);
+        dev->gen_thread = task;
+        break;
+    case SIMTEMP_GEN_SOFTIRQ:
+    case SIMTEMP_GEN_HARDIRQ:
+    default:
+        hrtimer_init(&dev->timer, CLOCK_MONOTONIC, simtemp_timer_mode(dev));
+        dev->timer.function = simtemp_timer_callback;
+        simtemp_timer_arm(dev, dev->start_expiry);
+        break;
+    }
+
+    dev->gen_running = true;
+    pr_info("simtemp: Generation started (%s, %u ms interval)\n",
+            simtemp_gen_mode_names[dev->gen_mode], dev->sampling_ms);
+
+    return 0;
+}
+
+/**
+ * simtemp_gen_stop - Stop sample generation
+ * @dev: Device structure
+ * 
+ * Caller must hold dev->gen_lock. Returns once no tick is running.
+ */
+static void simtemp_gen_stop(struct simtemp_device *dev)
+{
+    unsigned int k;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (!dev->gen_running)
+        return;
+
+    if (dev->source == SIMTEMP_SRC_REPLAY) {
+        simtemp_replay_stop(dev);
+    } else if (dev->gen_mode == SIMTEMP_GEN_THREAD) {
+        kthread_stop(dev->gen_thread);
+        dev->gen_thread = NULL;
+    } else {
+        hrtimer_cancel(&dev->timer);
+    }
+
+    /* Let a period still being generated by the shards complete */
+    for (k = 0; k < dev->nr_shards; k++)
+        flush_work(&dev->shards[k].work);
+
+    dev->gen_running = false;
+    dev->start_expiry = 0;
+    pr_info("simtemp: Generation stopped\n");
+}
+
+/**
+ * simtemp_gen_restart - Apply new timer settings to a running generator
+ * @dev: Device structure
+ * 
+ * Caller must hold dev->gen_lock.
+ */
+int simtemp_gen_restart(struct simtemp_device *dev)
+{
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (!dev->gen_running)
+        return 0;
+
+    simtemp_gen_stop(dev);
+    return simtemp_gen_start(dev);
+}
+
+/**
+ * simtemp_gen_migrate - Move a running generator onto dev->gen_cpus
+ * @dev: Device structure
+ * 
+ * Shard work items follow from the next period on. The thread is
+ * simply re-affined by the scheduler. The timer is cancelled and queued
+ * again on the new CPU with its pending expiry, so the sampling phase is
+ * kept and no period is skipped or doubled.
+ * 
+ * Caller must hold dev->gen_lock.
+ */
+static int simtemp_gen_migrate(struct simtemp_device *dev)
+{
+    ktime_t expires;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (!dev->gen_running)
+        return 0;
+
+    simtemp_shards_place(dev);
+
+    if (dev->source == SIMTEMP_SRC_REPLAY)
+        return set_cpus_allowed_ptr(dev->replay.thread, &dev->gen_cpus);
+    if (dev->gen_mode == SIMTEMP_GEN_THREAD)
+        return set_cpus_allowed_ptr(dev->gen_thread, &dev->gen_cpus);
+
+    hrtimer_cancel(&dev->timer);
+    expires = hrtimer_get_softexpires(&dev->timer);
+    simtemp_timer_arm(dev, expires);
+
+    return 0;
+}
+
+/**
+ * simtemp_set_sampling_ms - Change the sampling period
+ * @dev: Device structure
+ * @ms: New period in milliseconds, non-zero
+ * 
+ * A running generator is restarted on the new period. The timer slack
+ * is trimmed to stay below one period.
+ * 
+ * Returns: 0 on success, negative errno if the restart failed
+ */
+int simtemp_set_sampling_ms(struct simtemp_device *dev, u32 ms)
+{
+    int ret;
+
+    mutex_lock(&dev->gen_lock);
+    WRITE_ONCE(dev->sampling_ms, ms);
+    dev->timer_interval = ktime_set(0, ms * 1000000ULL);
+    WRITE_ONCE(dev->slack_ns, min_t(u64, dev->slack_ns, ms * 1000000ULL - 1));
+    simtemp_wave_update(dev);
+    ret = simtemp_gen_restart(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return ret;
+}
+
+/**
+ * __simtemp_set_threshold - Change the alert threshold, trip point aside
+ * @dev: Device structure
+ * @threshold_mC: New threshold
+ * 
+ * For the thermal zone's set_trip_temp(), where the thermal core moves
+ * the trip itself under the zone lock. Everyone else goes through
+ * simtemp_set_threshold().
+ */
+void __simtemp_set_threshold(struct simtemp_device *dev, s32 threshold_mC)
+{
+    WRITE_ONCE(dev->threshold_mC, threshold_mC);
+}
+
+/**
+ * simtemp_set_threshold - Change the alert threshold
+ * @dev: Device structure, bound to the driver
+ * @threshold_mC: New threshold
+ * 
+ * Flags and events use the new value from the next period, and the
+ * thermal trip point follows, so both always agree.
+ */
+void simtemp_set_threshold(struct simtemp_device *dev, s32 threshold_mC)
+{
+    __simtemp_set_threshold(dev, threshold_mC);
+    simtemp_thermal_sync_trip(dev);
+}
+
+/**
+ * simtemp_session_get - Account one more consumer of the sample stream
+ * @dev: Device structure
+ * 
+ * Consumers are open files and the enabled IIO buffer. The first one
+ * starts a new session: a fresh stream, the pre-roll, the generator.
+ * Caller must hold dev->gen_lock.
+ * 
+ * Returns: 0 on success, negative errno if generation cannot start
+ */
+int simtemp_session_get(struct simtemp_device *dev)
+{
+    unsigned int k;
+    int ret;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (dev->open_count == 0) {
+        /* Samples from a previous session are stale, hide them */
+        for (k = 0; k < dev->nr_shards; k++)
+            dev->shards[k].stream_start = dev->shards[k].published;
+        /* Sessions start at the full rate */
+        dev->rate_shift = 0;
+        dev->rate_changed = false;
+        dev->period_flags = 0;
+        dev->exceeded = false;
+        /* The pre-roll ends where the generator takes over */
+        dev->start_expiry = simtemp_first_expiry(dev);
+        simtemp_preroll(dev);
+
+        ret = simtemp_gen_start(dev);
+        if (ret) {
+            dev->start_expiry = 0;
+            return ret;
+        }
+    }
+    dev->open_count++;
+
+    return 0;
+}
+
+/* Drop a consumer, caller must hold dev->gen_lock */
+void simtemp_session_put(struct simtemp_device *dev)
+{
+    lockdep_assert_held(&dev->gen_lock);
+
+    /* Nobody left to consume samples: stop waking the CPU up */
+    if (--dev->open_count == 0)
+        simtemp_gen_stop(dev);
+}
+
+/*
+ * Device lifetime
+ *
+ * Open files keep the device structure alive after the platform device
+ * is gone (module unload is blocked by the open files, configfs rmdir is
+ * not), so it is reference counted instead of devm allocated.
+ */
+
+static void simtemp_release_dev(struct kref *ref)
+{
+    struct simtemp_device *dev = container_of(ref, struct simtemp_device, ref);
+
+    simtemp_iio_free(dev);
+    simtemp_genl_exit(dev);
+    simtemp_stats_exit(dev);
+    simtemp_replay_exit(dev);
+    simtemp_shards_free(dev->shards, dev->nr_shards);
+    free_percpu(dev->counters);
+    kfree(dev);
+}
+
+static void simtemp_put(struct simtemp_device *dev)
+{
+    kref_put(&dev->ref, simtemp_release_dev);
+}
+
+/*
+ * Character device operations
+ */
+
+static int simtemp_open(struct inode *inode, struct file *filp)
+{
+    /* misc_open() points private_data at our miscdevice */
+    struct simtemp_device *dev = container_of(filp->private_data,
+                                              struct simtemp_device, mdev);
+    struct simtemp_reader *reader;
+    struct simtemp_shard *shard;
+    unsigned int k;
+    int ret;
+
+    /* gen_lock keeps the shard layout stable while we size the cursors */
+    mutex_lock(&dev->gen_lock);
+    if (dev->dead) {
+        ret = -ENODEV;
+        goto err_unlock;
+    }
+
+    reader = kzalloc(struct_size(reader, cursors, dev->nr_shards), GFP_KERNEL);
+    if (!reader) {
+        ret = -ENOMEM;
+        goto err_unlock;
+    }
+
+    reader->dev = dev;
+    reader->decimation = 1;
+    reader->watermark = 1;
+    reader->clock = CLOCK_MONOTONIC;
+    mutex_init(&reader->read_lock);
+
+    ret = simtemp_reader_stats_init(reader);
+    if (ret)
+        goto err_free;
+
+    ret = simtemp_session_get(dev);
+    if (ret)
+        goto err_stats;
+
+    /*
+     * Start with whatever the ring holds for the current session (the
+     * pre-roll included), like a FIFO would.
+     */
+    for (k = 0; k < dev->nr_shards; k++) {
+        shard = &dev->shards[k];
+        spin_lock_irq(&shard->ring.lock);
+        reader->cursors[k] = max(ring_buffer_oldest(&shard->ring),
+                                 shard->stream_start);
+        spin_unlock_irq(&shard->ring.lock);
+    }
+
+    spin_lock(&dev->readers_lock);
+    list_add_tail_rcu(&reader->node, &dev->readers);
+    spin_unlock(&dev->readers_lock);
+    mutex_unlock(&dev->gen_lock);
+
+    /* Keeps dev alive after a removal, until this file is closed */
+    kref_get(&dev->ref);
+
+    pr_info("simtemp: Device opened\n");
+    filp->private_data = reader;
+    return 0;
+
+err_stats:
+    simtemp_reader_stats_exit(reader);
+err_free:
+    kfree(reader);
+err_unlock:
+    mutex_unlock(&dev->gen_lock);
+    return ret;
+}
+
+/* Grace period over, the sampling path no longer sees the reader */
+static void simtemp_reader_free_rcu(struct rcu_head *rcu)
+{
+    struct simtemp_reader *reader = container_of(rcu, struct simtemp_reader,
+                                                 rcu);
+    struct eventfd_ctx *ctx = rcu_dereference_protected(reader->eventfd, 1);
+
+    if (ctx)
+        eventfd_ctx_put(ctx);
+    kfree(reader);
+}
+
+static int simtemp_release(struct inode *inode, struct file *filp)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+
+    mutex_lock(&dev->gen_lock);
+    spin_lock(&dev->readers_lock);
+    list_del_rcu(&reader->node);
+    spin_unlock(&dev->readers_lock);
+
+    simtemp_session_put(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    simtemp_reader_stats_exit(reader);
+    call_rcu(&reader->rcu, simtemp_reader_free_rcu);
+    simtemp_put(dev);
+
+    pr_info("simtemp: Device closed\n");
+    return 0;
+}
+
+/**
+ * simtemp_reader_wants - Apply the per-file filter and decimation
+ * @reader: Reader state
+ * @sample: Candidate sample
+ * 
+ * Decimation counts sample periods, so every channel of a kept period
+ * is delivered.
+ */
+static bool simtemp_reader_wants(struct simtemp_reader *reader,
+                                 const struct simtemp_sample_v2 *sample)
+{
+    u32 filter = READ_ONCE(reader->filter);
+    u32 decimation = READ_ONCE(reader->decimation);
+
+    if ((sample->flags & filter) != filter)
+        return false;
+
+    return decimation <= 1 || sample->seq % decimation == 0;
+}
+
+/* Account samples a reader lost to overwrites in shard @k */
+static void simtemp_reader_lost(struct simtemp_reader *reader, unsigned int k,
+                                u64 timestamp_ns, u64 lost)
+{
+    struct simtemp_event ev = {
+        .type = SIMTEMP_GENL_EVENT_OVERFLOW,
+        .pid = reader->pid,
+        .timestamp_ns = timestamp_ns,
+        .lost = lost,
+    };
+
+    reader->overflows += lost;
+    trace_simtemp_overwrite(reader->dev->mdev.name, timestamp_ns,
+                            reader->cursors[k], lost);
+    simtemp_genl_notify(reader->dev, &ev);
+}
+
+/**
+ * simtemp_reader_merge - Pull the oldest published samples of a reader
+ * @reader: Reader state
+ * @samples: Output array
+ * @max: Capacity of @samples
+ * 
+ * With several shards, every shard ring is peeked and the one holding
+ * the oldest sample wins; all its consecutive samples of that period
+ * are taken in one go. Only complete periods (dev->published_ns) are
+ * considered, so the result is ordered by timestamp, then channel.
+ * 
+ * Returns: number of samples stored, 0 if nothing is pending
+ */
+static unsigned int simtemp_reader_merge(struct simtemp_reader *reader,
+                                         struct simtemp_sample_v2 *samples,
+                                         unsigned int max)
+{
+    struct simtemp_device *dev = reader->dev;
+    u64 limit = smp_load_acquire(&dev->published_ns);
+    u64 ts, best_ts = U64_MAX, seq, lost;
+    unsigned int k, n, best = 0;
+    bool found = false;
+
+    if (dev->nr_shards == 1) {
+        n = ring_buffer_get(&dev->shards[0].ring, &reader->cursors[0],
+                            samples, max, limit, &seq, &lost);
+        if (lost)
+            simtemp_reader_lost(reader, 0, n ? samples[0].timestamp_ns : 0,
+                                lost);
+        return n;
+    }
+
+    for (k = 0; k < dev->nr_shards; k++) {
+        if (!ring_buffer_peek(&dev->shards[k].ring, &reader->cursors[k],
+                              &ts, &lost)) {
+            if (lost)
+                simtemp_reader_lost(reader, k, 0, lost);
+            continue;
+        }
+        if (lost)
+            simtemp_reader_lost(reader, k, ts, lost);
+        /* Ties go to the lower shard, which holds the lower channels */
+        if (ts <= limit && ts < best_ts) {
+            best_ts = ts;
+            best = k;
+            found = true;
+        }
+    }
+
+    if (!found)
+        return 0;
+
+    n = ring_buffer_get(&dev->shards[best].ring, &reader->cursors[best],
+                        samples, max, best_ts, &seq, &lost);
+    if (lost)
+        simtemp_reader_lost(reader, best, best_ts, lost);
+
+    return n;
+}
+
+/**
+ * simtemp_reader_fetch - Pull the next deliverable samples of a reader
+ * @reader: Reader state
+ * @samples: Output array
+ * @max: Capacity of @samples
+ * 
+ * Returns: number of samples stored, 0 if the ring holds nothing for
+ * this reader (samples rejected by the filter are consumed silently)
+ */
+static unsigned int simtemp_reader_fetch(struct simtemp_reader *reader,
+                                         struct simtemp_sample_v2 *samples,
+                                         unsigned int max)
+{
+    unsigned int n, i, kept;
+
+    do {
+        n = simtemp_reader_merge(reader, samples, max);
+
+        for (i = 0, kept = 0; i < n; i++) {
+            if (simtemp_reader_wants(reader, &samples[i]))
+                samples[kept++] = samples[i];
+        }
+    } while (n && !kept);
+
+    return kept;
+}
+
+/**
+ * simtemp_samples_to_clock - Report timestamps in the file's clock
+ * @clock: clockid selected with SIMTEMP_IOC_SET_CLOCK
+ * @samples: Samples as stored in the ring
+ * @n: Number of samples
+ * 
+ * REALTIME was converted at generation into wall_ns. BOOTTIME and TAI
+ * only move against REALTIME on clock steps (settimeofday, NTP, leap
+ * seconds), never across suspend, so one offset serves the batch.
+ */
+static void simtemp_samples_to_clock(u32 clock,
+                                     struct simtemp_sample_v2 *samples,
+                                     unsigned int n)
+{
+    ktime_t real = ktime_mono_to_any(0, TK_OFFS_REAL);
+    s64 offs;
+    unsigned int i;
+
+    switch (clock) {
+    case CLOCK_BOOTTIME:
+        offs = ktime_to_ns(ktime_sub(ktime_mono_to_any(0, TK_OFFS_BOOT), real));
+        break;
+    case CLOCK_TAI:
+        offs = ktime_to_ns(ktime_sub(ktime_mono_to_any(0, TK_OFFS_TAI), real));
+        break;
+    case CLOCK_REALTIME:
+        offs = 0;
+        break;
+    default:
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        samples[i].timestamp_ns = samples[i].wall_ns + offs;
+}
+
+/*
+ * Rewrite @samples in place as v1 records, the format of files that
+ * did not ask for v2. v1 record i ends before v2 record i + 1 starts,
+ * so converting in ascending order never clobbers unread input.
+ */
+static void simtemp_samples_to_v1(struct simtemp_sample_v2 *samples,
+                                  unsigned int n)
+{
+    struct simtemp_sample *out = (struct simtemp_sample *)samples;
+    struct simtemp_sample v1;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        v1.timestamp_ns = samples[i].timestamp_ns;
+        v1.temp_mC = samples[i].temp_mC;
+        v1.flags = samples[i].flags;
+        memcpy(&out[i], &v1, sizeof(v1));
+    }
+}
+
+static u8 *simtemp_put_varint(u8 *p, u64 val)
+{
+    while (val >= 0x80) {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+
+    return p;
+}
+
+static u8 *simtemp_put_zigzag(u8 *p, s64 val)
+{
+    return simtemp_put_varint(p, ((u64)val << 1) ^ (u64)(val >> 63));
+}
+
+/**
+ * simtemp_samples_to_delta - Encode samples as one SIMTEMP_FORMAT_DELTA batch
+ * @samples: Samples, timestamps already in the file's clock
+ * @n: Number of samples, at least 1
+ * @out: Room for the header and n * SIMTEMP_DELTA_MAX_SAMPLE bytes
+ * 
+ * The period is taken from the first timestamp change in the batch, so
+ * decimation, adaptive rates and replayed traces are predicted as well
+ * as the plain timer. Layout in nxp_simtemp_ioctl.h. Also used by the
+ * relay channel (nxp_simtemp_relay.c).
+ * 
+ * Returns: bytes stored in @out
+ */
+size_t simtemp_samples_to_delta(const struct simtemp_sample_v2 *samples,
+                                unsigned int n, u8 *out)
+{
+    struct simtemp_delta_batch hdr = {
+        .base_ns = samples[0].timestamp_ns,
+        .count = n,
+    };
+    u8 *p = out + sizeof(hdr);
+    u64 prev_ts = hdr.base_ns, step;
+    s64 prev_channel = -1;
+    s32 prev_temp = 0;
+    unsigned int i;
+
+    for (i = 1; i < n; i++) {
+        if (samples[i].timestamp_ns != hdr.base_ns) {
+            hdr.period_ns = samples[i].timestamp_ns - hdr.base_ns;
+            break;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        step = samples[i].channel > prev_channel ? 0 : hdr.period_ns;
+        p = simtemp_put_varint(p, samples[i].flags);
+        p = simtemp_put_zigzag(p, samples[i].channel - (prev_channel + 1));
+        p = simtemp_put_zigzag(p, samples[i].timestamp_ns - prev_ts - step);
+        p = simtemp_put_zigzag(p, (s64)samples[i].temp_mC - prev_temp);
+        prev_channel = samples[i].channel;
+        prev_ts = samples[i].timestamp_ns;
+        prev_temp = samples[i].temp_mC;
+    }
+
+    hdr.bytes = p - out - sizeof(hdr);
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return p - out;
+}
+
+/* Samples of the file's format that are sure to fit in @count bytes */
+static unsigned int simtemp_read_max(u32 format, size_t count)
+{
+    switch (format) {
+    case SIMTEMP_FORMAT_V2:
+        count /= sizeof(struct simtemp_sample_v2);
+        break;
+    case SIMTEMP_FORMAT_DELTA:
+        if (count < sizeof(struct simtemp_delta_batch))
+            return 0;
+        count = (count - sizeof(struct simtemp_delta_batch)) /
+                SIMTEMP_DELTA_MAX_SAMPLE;
+        break;
+    default:
+        count /= sizeof(struct simtemp_sample);
+        break;
+    }
+
+    return min_t(size_t, count, SIMTEMP_READ_BATCH);
+}
+
+static ssize_t simtemp_read(struct file *filp, char __user *buf,
+                            size_t count, loff_t *f_pos)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+    struct simtemp_sample_v2 *samples = reader->read_samples;
+    unsigned int max, n, i;
+    size_t copied = 0, len;
+    u64 latency, now, first_ts;
+    u32 clock, format, live;
+    const void *out;
+    ssize_t ret;
+
+    if (READ_ONCE(dev->dead))
+        return -ENODEV;
+
+    pr_debug("simtemp: Read requested, count=%zu\n", count);
+
+    /* Record layout selected with SIMTEMP_IOC_SET_READER_CONFIG */
+    format = READ_ONCE(reader->format);
+    max = simtemp_read_max(format, count);
+    if (!max)
+        return -EINVAL;
+
+    /* Threads sharing the file share its staging buffers */
+    if (mutex_lock_interruptible(&reader->read_lock))
+        return -ERESTARTSYS;
+
+    /* Try to get samples from ring buffer */
+    n = simtemp_reader_fetch(reader, samples, max);
+    while (!n) {
+        /* Buffer empty */
+        if (filp->f_flags & O_NONBLOCK) {
+            simtemp_count(dev->counters, read_eagain);
+            ret = -EAGAIN;
+            goto out;
+        }
+
+        /* Blocking read: wait for data, without blocking other threads */
+        mutex_unlock(&reader->read_lock);
+        pr_debug("simtemp: Buffer empty, waiting for data...\n");
+        ret = wait_event_interruptible(dev->wait_queue,
+                simtemp_reader_lag(reader) >= READ_ONCE(reader->watermark) ||
+                READ_ONCE(dev->dead));
+        if (ret)
+            return ret; /* Interrupted by signal */
+        if (READ_ONCE(dev->dead))
+            return -ENODEV;
+        if (mutex_lock_interruptible(&reader->read_lock))
+            return -ERESTARTSYS;
+
+        /* Try again after waking up */
+        n = simtemp_reader_fetch(reader, samples, max);
+        if (!n) {
+            /* Everything pending was filtered out, or another thread won */
+            pr_debug("simtemp: Woke up but nothing to deliver\n");
+            simtemp_count(dev->counters, spurious_wakeups);
+        }
+    }
+
+    /* Copy to user space, topping up from the ring while room is left */
+    do {
+        /* Time the samples spent between generation and delivery */
+        now = ktime_get_ns();
+        live = READ_ONCE(dev->live_seq);
+        for (i = 0; i < n; i++) {
+            /* Pre-rolled periods were stamped in the past on purpose */
+            if ((s32)(samples[i].seq - live) < 0)
+                continue;
+            latency = now - samples[i].timestamp_ns;
+            simtemp_hist_record(&reader->delivery_latency, latency);
+            simtemp_hist_record(&dev->stats.delivery_latency, latency);
+        }
+        first_ts = samples[0].timestamp_ns;
+
+        clock = READ_ONCE(reader->clock);
+        if (clock != CLOCK_MONOTONIC)
+            simtemp_samples_to_clock(clock, samples, n);
+        switch (format) {
+        case SIMTEMP_FORMAT_V2:
+            len = n * sizeof(struct simtemp_sample_v2);
+            out = samples;
+            break;
+        case SIMTEMP_FORMAT_DELTA:
+            len = simtemp_samples_to_delta(samples, n, reader->read_delta);
+            out = reader->read_delta;
+            break;
+        default:
+            simtemp_samples_to_v1(samples, n);
+            len = n * sizeof(struct simtemp_sample);
+            out = samples;
+            break;
+        }
+        if (copy_to_user(buf + copied, out, len)) {
+            ret = copied ? copied : -EFAULT;
+            goto out;
+        }
+        copied += len;
+        this_cpu_add(dev->counters->delivered, n);
+
+        trace_simtemp_read(dev->mdev.name, first_ts,
+                           simtemp_reader_pos(reader), n);
+
+        max = simtemp_read_max(format, count - copied);
+        n = max ? simtemp_reader_fetch(reader, samples, max) : 0;
+    } while (n);
+    ret = copied;
+
+out:
+    mutex_unlock(&reader->read_lock);
+    return ret;
+}
+
+/* SIGIO on the events that signal the eventfd, see SIMTEMP_IOC_SET_EVENTFD */
+static int simtemp_fasync(int fd, struct file *filp, int on)
+{
+    struct simtemp_reader *reader = filp->private_data;
+
+    return fasync_helper(fd, filp, on, &reader->fasync);
+}
+
+/**
+ * simtemp_set_eventfd - Attach or detach the eventfd of a reader
+ * @reader: Reader state
+ * @fd: eventfd, or -1 to detach
+ * 
+ * The sampling path dereferences the eventfd under RCU, so the old one
+ * is only released after a grace period.
+ */
+static int simtemp_set_eventfd(struct simtemp_reader *reader, int fd)
+{
+    struct simtemp_device *dev = reader->dev;
+    struct eventfd_ctx *ctx = NULL, *old;
+
+    if (fd >= 0) {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    } else if (fd != -1) {
+        return -EINVAL;
+    }
+
+    spin_lock(&dev->readers_lock);
+    old = rcu_replace_pointer(reader->eventfd, ctx,
+                              lockdep_is_held(&dev->readers_lock));
+    spin_unlock(&dev->readers_lock);
+
+    if (old) {
+        synchronize_rcu();
+        eventfd_ctx_put(old);
+    }
+
+    return 0;
+}
+
+static __poll_t simtemp_poll(struct file *filp, poll_table *wait)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+    __poll_t mask = 0;
+
+    simtemp_count(dev->counters, poll_calls);
+
+    /* Add our wait queue to the poll table */
+    poll_wait(filp, &dev->wait_queue, wait);
+
+    /* The sensor was removed while we had it open */
+    if (READ_ONCE(dev->dead))
+        return POLLERR | POLLHUP;
+
+    /* Check if enough data is available */
+    if (simtemp_reader_lag(reader) >= READ_ONCE(reader->watermark))
+        mask |= POLLIN | POLLRDNORM; /* Data available for reading */
+
+    trace_simtemp_poll(dev->mdev.name, simtemp_reader_pos(reader),
+                       simtemp_published(dev), (__force unsigned int)mask);
+
+    return mask;
+}
+
+/**
+ * simtemp_show_fdinfo - Per open file state in /proc/<pid>/fdinfo/<fd>
+ * @m: seq_file to print into
+ * @filp: Open file
+ * 
+ * Positions are summed over all shards. The lag is what the reader can
+ * still get, overwritten samples not included, as used for wakeups.
+ */
+static void simtemp_show_fdinfo(struct seq_file *m, struct file *filp)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+
+    seq_printf(m, "simtemp-device:\t%s\n", dev->mdev.name);
+    seq_printf(m, "simtemp-cursor:\t%llu\n", simtemp_reader_pos(reader));
+    seq_printf(m, "simtemp-head:\t%llu\n", simtemp_published(dev));
+    seq_printf(m, "simtemp-lag:\t%llu\n", simtemp_reader_lag(reader));
+    seq_printf(m, "simtemp-overflows:\t%llu\n", READ_ONCE(reader->overflows));
+    seq_printf(m, "simtemp-filter:\t0x%x\n", READ_ONCE(reader->filter));
+    seq_printf(m, "simtemp-decimation:\t%u\n", READ_ONCE(reader->decimation));
+    seq_printf(m, "simtemp-watermark:\t%u\n", READ_ONCE(reader->watermark));
+    seq_printf(m, "simtemp-format:\t%u\n", READ_ONCE(reader->format));
+    seq_printf(m, "simtemp-clock:\t%u\n", READ_ONCE(reader->clock));
+}
+
+/**
+ * simtemp_counters_sum - Fold the per-CPU counters into one snapshot
+ * @dev: Device structure
+ * @out: Summed counters
+ */
+static void simtemp_counters_sum(struct simtemp_device *dev,
+                                 struct simtemp_counters *out)
+{
+    int cpu;
+
+    memset(out, 0, sizeof(*out));
+
+    for_each_possible_cpu(cpu) {
+        struct simtemp_counters *c = per_cpu_ptr(dev->counters, cpu);
+
+        out->generated += READ_ONCE(c->generated);
+        out->delivered += READ_ONCE(c->delivered);
+        out->overwritten += READ_ONCE(c->overwritten);
+        out->read_eagain += READ_ONCE(c->read_eagain);
+        out->spurious_wakeups += READ_ONCE(c->spurious_wakeups);
+        out->poll_calls += READ_ONCE(c->poll_calls);
+        out->lock_contended += READ_ONCE(c->lock_contended);
+    }
+}
+
+/*
+ * Copy the latest value of the channels set in @mask (all if NULL) from
+ * period @seq. Returns the number of values stored.
+ */
+static u32 simtemp_snapshot_fill(struct simtemp_device *dev, u64 seq,
+                                 const unsigned long *mask,
+                                 struct simtemp_channel_value *vals,
+                                 u64 *timestamp_ns)
+{
+    const struct simtemp_sample_v2 *period;
+    struct simtemp_shard *shard;
+    unsigned int k;
+    u32 i, n = 0;
+
+    *timestamp_ns = simtemp_shard_period(&dev->shards[0], seq)->timestamp_ns;
+
+    for (k = 0; k < dev->nr_shards; k++) {
+        shard = &dev->shards[k];
+        period = simtemp_shard_period(shard, seq);
+
+        for (i = 0; i < shard->nr_channels; i++) {
+            if (mask && !test_bit(shard->first_channel + i, mask))
+                continue;
+            vals[n].temp_mC = period[i].temp_mC;
+            vals[n].flags = period[i].flags;
+            vals[n].channel = period[i].channel;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * simtemp_get_snapshot - SIMTEMP_IOC_GET_SNAPSHOT
+ * @dev: Device structure
+ * @argp: User struct simtemp_snapshot
+ * 
+ * Every shard keeps its last two periods. The copy is taken from the
+ * last published one and retried if the generation moved on meanwhile,
+ * since the buffer is reused two periods later. The result is never
+ * torn: all values belong to the period reported in timestamp_ns.
+ * 
+ * Returns: 0 on success, -ENODATA before the first period, -ENOSPC if
+ * nr_channels is too small (set to the required count)
+ */
+static int simtemp_get_snapshot(struct simtemp_device *dev, void __user *argp)
+{
+    struct simtemp_snapshot snap;
+    struct simtemp_channel_value *vals;
+    unsigned long *mask = NULL;
+    u32 wanted, n;
+    u64 seq, ts;
+    int ret = 0;
+
+    if (copy_from_user(&snap, argp, sizeof(snap)))
+        return -EFAULT;
+    if (snap.reserved)
+        return -EINVAL;
+
+    wanted = dev->num_channels;
+    if (snap.mask_ptr) {
+        u64 *words;
+
+        words = memdup_array_user(u64_to_user_ptr(snap.mask_ptr),
+                                  BITS_TO_U64(dev->num_channels),
+                                  sizeof(u64));
+        if (IS_ERR(words))
+            return PTR_ERR(words);
+
+        mask = bitmap_zalloc(dev->num_channels, GFP_KERNEL);
+        if (mask)
+            bitmap_from_arr64(mask, words, dev->num_channels);
+        kfree(words);
+        if (!mask)
+            return -ENOMEM;
+        wanted = bitmap_weight(mask, dev->num_channels);
+    }
+
+    if (snap.nr_channels < wanted) {
+        snap.nr_channels = wanted;
+        ret = copy_to_user(argp, &snap, sizeof(snap)) ? -EFAULT : -ENOSPC;
+        goto out_mask;
+    }
+
+    vals = kvmalloc_array(max(wanted, 1U), sizeof(*vals), GFP_KERNEL);
+    if (!vals) {
+        ret = -ENOMEM;
+        goto out_mask;
+    }
+
+    do {
+        seq = smp_load_acquire(&dev->tick_seq);
+        if (!seq) {
+            ret = -ENODATA;
+            goto out_vals;
+        }
+        n = simtemp_snapshot_fill(dev, seq - 1, mask, vals, &ts);
+        smp_rmb();
+    } while (READ_ONCE(dev->tick_seq) != seq);
+
+    snap.timestamp_ns = ts;
+    snap.generation = seq;
+    snap.nr_channels = n;
+    if (copy_to_user(u64_to_user_ptr(snap.values_ptr), vals,
+                     n * sizeof(*vals)) ||
+        copy_to_user(argp, &snap, sizeof(snap)))
+        ret = -EFAULT;
+
+out_vals:
+    kvfree(vals);
+out_mask:
+    bitmap_free(mask);
+    return ret;
+}
+
+/**
+ * simtemp_get_topk - SIMTEMP_IOC_GET_TOPK
+ * @dev: Device structure
+ * @argp: User struct simtemp_topk
+ * 
+ * Merges the per-shard heaps of the last published period, at most
+ * SIMTEMP_TOPK_MAX candidates per shard, instead of scanning every
+ * channel. Same retry rule as simtemp_get_snapshot().
+ */
+static int simtemp_get_topk(struct simtemp_device *dev, void __user *argp)
+{
+    struct simtemp_topk topk;
+    struct simtemp_topk_heap heap;
+    const struct simtemp_topk_heap *shard_heap;
+    unsigned int k;
+    u64 seq;
+    u32 i;
+
+    if (copy_from_user(&topk, argp, sizeof(topk)))
+        return -EFAULT;
+    if (topk.reserved || !topk.k || topk.k > SIMTEMP_TOPK_MAX)
+        return -EINVAL;
+
+    do {
+        seq = smp_load_acquire(&dev->tick_seq);
+        if (!seq)
+            return -ENODATA;
+
+        heap.nr = 0;
+        for (k = 0; k < dev->nr_shards; k++) {
+            shard_heap = &dev->shards[k].topk[(seq - 1) & 1];
+            for (i = 0; i < shard_heap->nr; i++)
+                simtemp_topk_push(&heap, topk.k, &shard_heap->v[i]);
+        }
+        topk.timestamp_ns =
+            simtemp_shard_period(&dev->shards[0], seq - 1)->timestamp_ns;
+        smp_rmb();
+    } while (READ_ONCE(dev->tick_seq) != seq);
+
+    memset(topk.values, 0, sizeof(topk.values));
+    topk.k = simtemp_topk_drain(&heap, topk.values);
+    topk.generation = seq;
+
+    if (copy_to_user(argp, &topk, sizeof(topk)))
+        return -EFAULT;
+    return 0;
+}
+
+static long simtemp_ioctl(struct file *filp, unsigned int cmd,
+                          unsigned long arg)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+    void __user *argp = (void __user *)arg;
+
+    switch (cmd) {
+    case SIMTEMP_IOC_GET_COUNTERS: {
+        struct simtemp_counters counters;
+
+        simtemp_counters_sum(dev, &counters);
+        if (copy_to_user(argp, &counters, sizeof(counters)))
+            return -EFAULT;
+        return 0;
+    }
+    case SIMTEMP_IOC_SET_READER_CONFIG: {
+        struct simtemp_reader_config cfg;
+
+        if (copy_from_user(&cfg, argp, sizeof(cfg)))
+            return -EFAULT;
+        /* The lag never exceeds what the rings hold of every channel */
+        if (cfg.format > SIMTEMP_FORMAT_DELTA || !cfg.decimation ||
+            !cfg.watermark ||
+            cfg.watermark > (u64)RING_BUFFER_SIZE * dev->num_channels ||
+            cfg.filter & ~(SIMTEMP_FLAG_NEW_SAMPLE |
+                           SIMTEMP_FLAG_THRESHOLD_EXCEEDED |
+                           SIMTEMP_FLAG_RATE_CHANGE))
+            return -EINVAL;
+
+        WRITE_ONCE(reader->filter, cfg.filter);
+        WRITE_ONCE(reader->decimation, cfg.decimation);
+        WRITE_ONCE(reader->watermark, cfg.watermark);
+        WRITE_ONCE(reader->format, cfg.format);
+
+        /* A lower watermark may already be satisfied */
+        wake_up_interruptible(&dev->wait_queue);
+        return 0;
+    }
+    case SIMTEMP_IOC_SET_CLOCK: {
+        u32 clock;
+
+        if (get_user(clock, (u32 __user *)argp))
+            return -EFAULT;
+        if (clock != CLOCK_MONOTONIC && clock != CLOCK_REALTIME &&
+            clock != CLOCK_BOOTTIME && clock != CLOCK_TAI)
+            return -EINVAL;
+
+        WRITE_ONCE(reader->clock, clock);
+        return 0;
+    }
+    case SIMTEMP_IOC_GET_CLOCK:
+        return put_user(READ_ONCE(reader->clock), (u32 __user *)argp);
+    case SIMTEMP_IOC_SET_EVENTFD: {
+        s32 fd;
+
+        if (get_user(fd, (s32 __user *)argp))
+            return -EFAULT;
+        return simtemp_set_eventfd(reader, fd);
+    }
+    case SIMTEMP_IOC_GET_SNAPSHOT:
+        return simtemp_get_snapshot(dev, argp);
+    case SIMTEMP_IOC_GET_TOPK:
+        return simtemp_get_topk(dev, argp);
+    case SIMTEMP_IOC_GET_READER_CONFIG: {
+        struct simtemp_reader_config cfg = {
+            .filter = READ_ONCE(reader->filter),
+            .decimation = READ_ONCE(reader->decimation),
+            .watermark = READ_ONCE(reader->watermark),
+            .format = READ_ONCE(reader->format),
+        };
+
+        if (copy_to_user(argp, &cfg, sizeof(cfg)))
+            return -EFAULT;
+        return 0;
+    }
+    default:
+        return -ENOTTY;
+    }
+}
+
+static const struct file_operations simtemp_fops = {
+    .owner = THIS_MODULE,
+    .open = simtemp_open,
+    .release = simtemp_release,
+    .read = simtemp_read,
+    .write = simtemp_replay_write,
+    .poll = simtemp_poll,
+    .fasync = simtemp_fasync,
+    .unlocked_ioctl = simtemp_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .show_fdinfo = simtemp_show_fdinfo,
+};
+
+/*
+ * sysfs attributes (/sys/class/misc/simtemp/)
+ */
+
+#define SIMTEMP_COUNTER_ATTR(field)                                     \
+static ssize_t field##_show(struct device *d,                           \
+                            struct device_attribute *attr, char *buf)   \
+{                                                                       \
+    struct simtemp_counters counters;                                   \
+                                                                        \
+    simtemp_counters_sum(simtemp_from_sysfs(d), &counters);             \
+    return sysfs_emit(buf, "%llu\n", counters.field);                   \
+}                                                                       \
+static DEVICE_ATTR_RO(field)
+
+SIMTEMP_COUNTER_ATTR(generated);
+SIMTEMP_COUNTER_ATTR(delivered);
+SIMTEMP_COUNTER_ATTR(overwritten);
+SIMTEMP_COUNTER_ATTR(read_eagain);
+SIMTEMP_COUNTER_ATTR(spurious_wakeups);
+SIMTEMP_COUNTER_ATTR(poll_calls);
+SIMTEMP_COUNTER_ATTR(lock_contended);
+
+static struct attribute *simtemp_counter_attrs[] = {
+    &dev_attr_generated.attr,
+    &dev_attr_delivered.attr,
+    &dev_attr_overwritten.attr,
+    &dev_attr_read_eagain.attr,
+    &dev_attr_spurious_wakeups.attr,
+    &dev_attr_poll_calls.attr,
+    &dev_attr_lock_contended.attr,
+    NULL,
+};
+
+static const struct attribute_group simtemp_counter_group = {
+    .name = "counters",
+    .attrs = simtemp_counter_attrs,
+};
+
+static ssize_t gen_mode_show(struct device *d, struct device_attribute *attr,
+                             char *buf)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+
+    return sysfs_emit(buf, "%s\n", simtemp_gen_mode_names[READ_ONCE(dev->gen_mode)]);
+}
+
+/* Switching context restarts generation and clears the timing histograms */
+static ssize_t gen_mode_store(struct device *d, struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    bool was_running;
+    int mode, ret = 0;
+
+    mode = sysfs_match_string(simtemp_gen_mode_names, buf);
+    if (mode < 0)
+        return mode;
+
+    mutex_lock(&dev->gen_lock);
+    if (mode != dev->gen_mode) {
+        was_running = dev->gen_running;
+        simtemp_gen_stop(dev);
+        WRITE_ONCE(dev->gen_mode, mode);
+        simtemp_stats_reset(dev);
+        if (was_running)
+            ret = simtemp_gen_start(dev);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(gen_mode);
+
+static ssize_t preroll_show(struct device *d, struct device_attribute *attr,
+                            char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->preroll));
+}
+
+/* Takes effect the next time generation starts (first open) */
+static ssize_t preroll_store(struct device *d, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val > RING_BUFFER_SIZE)
+        return -EINVAL;
+
+    mutex_lock(&dev->gen_lock);
+    dev->preroll = val;
+    mutex_unlock(&dev->gen_lock);
+
+    return count;
+}
+static DEVICE_ATTR_RW(preroll);
+
+static ssize_t align_show(struct device *d, struct device_attribute *attr,
+                          char *buf)
+{
+    return sysfs_emit(buf, "%d\n", READ_ONCE(simtemp_from_sysfs(d)->align));
+}
+
+static ssize_t align_store(struct device *d, struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    bool val;
+    int ret;
+
+    ret = kstrtobool(buf, &val);
+    if (ret)
+        return ret;
+
+    mutex_lock(&dev->gen_lock);
+    if (val != dev->align) {
+        WRITE_ONCE(dev->align, val);
+        ret = simtemp_gen_restart(dev);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(align);
+
+static ssize_t timer_slack_ns_show(struct device *d,
+                                   struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->slack_ns));
+}
+
+static ssize_t timer_slack_ns_store(struct device *d,
+                                    struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    /* Slack beyond one period would merge consecutive samples */
+    if (val >= ktime_to_ns(dev->timer_interval))
+        return -EINVAL;
+
+    mutex_lock(&dev->gen_lock);
+    if (val != dev->slack_ns) {
+        WRITE_ONCE(dev->slack_ns, val);
+        ret = simtemp_gen_restart(dev);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(timer_slack_ns);
+
+static ssize_t gen_cpus_show(struct device *d, struct device_attribute *attr,
+                             char *buf)
+{
+    return sysfs_emit(buf, "%*pbl\n",
+                      cpumask_pr_args(&simtemp_from_sysfs(d)->gen_cpus));
+}
+
+/* Accepts a CPU list ("2", "0-1,6"), at least one CPU must be online */
+static ssize_t gen_cpus_store(struct device *d, struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    cpumask_var_t mask;
+    int ret;
+
+    if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+        return -ENOMEM;
+
+    ret = cpulist_parse(buf, mask);
+    if (ret)
+        goto out;
+
+    cpumask_and(mask, mask, cpu_possible_mask);
+    if (!cpumask_intersects(mask, cpu_online_mask)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    mutex_lock(&dev->gen_lock);
+    if (!cpumask_equal(mask, &dev->gen_cpus)) {
+        cpumask_copy(&dev->gen_cpus, mask);
+        ret = simtemp_gen_migrate(dev);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+out:
+    free_cpumask_var(mask);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(gen_cpus);
+
+static ssize_t channels_show(struct device *d, struct device_attribute *attr,
+                             char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->num_channels));
+}
+
+/* Re-shards the channel array, only while the device is not open */
+static ssize_t channels_store(struct device *d, struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    struct simtemp_shard *old_shards;
+    unsigned int old_nr;
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (!val || val > SIMTEMP_MAX_CHANNELS)
+        return -EINVAL;
+
+    mutex_lock(&dev->gen_lock);
+    if (dev->open_count) {
+        ret = -EBUSY;
+    } else if (dev->source == SIMTEMP_SRC_REPLAY &&
+               val > SIMTEMP_SHARD_CHANNELS) {
+        ret = -EBUSY; /* Replay feeds a single shard */
+    } else if (val != dev->num_channels) {
+        old_shards = dev->shards;
+        old_nr = dev->nr_shards;
+        ret = simtemp_shards_alloc(dev, val);
+        if (!ret)
+            simtemp_shards_free(old_shards, old_nr);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(channels);
+
+static ssize_t shards_show(struct device *d, struct device_attribute *attr,
+                           char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->nr_shards));
+}
+static DEVICE_ATTR_RO(shards);
+
+static ssize_t adaptive_lag_show(struct device *d,
+                                 struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->adaptive_lag));
+}
+
+/* Periods the fastest reader may lag before the rate drops, 0 = fixed rate */
+static ssize_t adaptive_lag_store(struct device *d,
+                                  struct device_attribute *attr,
+                                  const char *buf, size_t count)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    /* Lag is bounded by the ring, a larger limit would never trigger */
+    if (val >= RING_BUFFER_SIZE)
+        return -EINVAL;
+
+    WRITE_ONCE(simtemp_from_sysfs(d)->adaptive_lag, val);
+    return count;
+}
+static DEVICE_ATTR_RW(adaptive_lag);
+
+static ssize_t rate_divider_show(struct device *d,
+                                 struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%u\n", 1U << READ_ONCE(simtemp_from_sysfs(d)->rate_shift));
+}
+static DEVICE_ATTR_RO(rate_divider);
+
+static const char * const simtemp_source_names[] = {
+    [SIMTEMP_SRC_RANDOM] = "random",
+    [SIMTEMP_SRC_REPLAY] = "replay",
+};
+
+static ssize_t source_show(struct device *d, struct device_attribute *attr,
+                           char *buf)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+
+    return sysfs_emit(buf, "%s\n", simtemp_source_names[READ_ONCE(dev->source)]);
+}
+
+/*
+ * Switching source restarts generation. Replay is limited to channel
+ * sets generated in a single shard, where the tick consumes the
+ * replayed value before the next record is due.
+ */
+static ssize_t source_store(struct device *d, struct device_attribute *attr,
+                            const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    bool was_running;
+    int source, ret = 0;
+
+    source = sysfs_match_string(simtemp_source_names, buf);
+    if (source < 0)
+        return source;
+
+    mutex_lock(&dev->gen_lock);
+    if (source == SIMTEMP_SRC_REPLAY && dev->nr_shards > 1) {
+        ret = -EBUSY;
+    } else if (source != dev->source) {
+        was_running = dev->gen_running;
+        simtemp_gen_stop(dev);
+        WRITE_ONCE(dev->source, source);
+        if (was_running)
+            ret = simtemp_gen_start(dev);
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(source);
+
+static ssize_t running_show(struct device *d, struct device_attribute *attr,
+                            char *buf)
+{
+    return sysfs_emit(buf, "%d\n", READ_ONCE(simtemp_from_sysfs(d)->gen_running));
+}
+static DEVICE_ATTR_RO(running);
+
+static struct attribute *simtemp_attrs[] = {
+    &dev_attr_gen_mode.attr,
+    &dev_attr_preroll.attr,
+    &dev_attr_align.attr,
+    &dev_attr_timer_slack_ns.attr,
+    &dev_attr_gen_cpus.attr,
+    &dev_attr_channels.attr,
+    &dev_attr_shards.attr,
+    &dev_attr_adaptive_lag.attr,
+    &dev_attr_rate_divider.attr,
+    &dev_attr_source.attr,
+    &dev_attr_running.attr,
+    NULL,
+};
+
+static const struct attribute_group simtemp_attr_group = {
+    .attrs = simtemp_attrs,
+};
+
+static const struct attribute_group *simtemp_groups[] = {
+    &simtemp_attr_group,
+    &simtemp_counter_group,
+    &simtemp_replay_group,
+    &simtemp_wave_group,
+    NULL,
+};
+
+/*
+ * Platform driver probe/remove
+ */
+
+static int simtemp_probe(struct platform_device *pdev)
+{
+    struct simtemp_device *dev;
+    const char *gen_mode, *profile;
+    u32 channels = 1;
+    int ret;
+
+    pr_info("simtemp: Probing device\n");
+
+    /* Allocate device structure, see simtemp_put() */
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+
+    kref_init(&dev->ref);
+    dev->pdev = pdev;
+    platform_set_drvdata(pdev, dev);
+    simtemp_genl_init(dev);
+
+    /* Parse Device Tree properties (with defaults) */
+    of_property_read_u32(pdev->dev.of_node, "sampling-ms", &dev->sampling_ms);
+    if (dev->sampling_ms == 0)
+        dev->sampling_ms = 100; /* Default 100ms */
+
+    of_property_read_u32(pdev->dev.of_node, "threshold-mC", &dev->threshold_mC);
+    if (dev->threshold_mC == 0)
+        dev->threshold_mC = 45000; /* Default 45.0°C */
+
+    of_property_read_u32(pdev->dev.of_node, "base-temp-mC", &dev->base_temp_mC);
+    if (dev->base_temp_mC == 0)
+        dev->base_temp_mC = 35000; /* Default 35.0°C */
+
+    of_property_read_u32(pdev->dev.of_node, "temp-variation-mC", 
+                         &dev->temp_variation_mC);
+    if (dev->temp_variation_mC == 0)
+        dev->temp_variation_mC = 10000; /* Default ±10.0°C */
+
+    dev->align = of_property_read_bool(pdev->dev.of_node, "align-to-period");
+    of_property_read_u32(pdev->dev.of_node, "timer-slack-ns", &dev->slack_ns);
+    dev->slack_ns = min_t(u32, dev->slack_ns,
+                          dev->sampling_ms * 1000000ULL - 1); /* Default 0 */
+
+    of_property_read_u32(pdev->dev.of_node, "preroll-samples", &dev->preroll);
+    dev->preroll = min_t(u32, dev->preroll, RING_BUFFER_SIZE); /* Default 0 */
+
+    dev->gen_mode = SIMTEMP_GEN_HARDIRQ; /* Default hrtimer in hard-IRQ */
+    if (!of_property_read_string(pdev->dev.of_node, "generation-mode",
+                                 &gen_mode)) {
+        ret = match_string(simtemp_gen_mode_names,
+                           ARRAY_SIZE(simtemp_gen_mode_names), gen_mode);
+        if (ret >= 0)
+            dev->gen_mode = ret;
+        else
+            dev_warn(&pdev->dev, "Unknown generation-mode \"%s\"\n", gen_mode);
+    }
+
+    dev->wave.profile = SIMTEMP_PROFILE_NOISE; /* Default uniform noise */
+    if (!of_property_read_string(pdev->dev.of_node, "waveform", &profile)) {
+        ret = match_string(simtemp_profile_names, SIMTEMP_PROFILE_NR, profile);
+        if (ret >= 0)
+            dev->wave.profile = ret;
+        else
+            dev_warn(&pdev->dev, "Unknown waveform \"%s\"\n", profile);
+    }
+    of_property_read_u32(pdev->dev.of_node, "waveform-period-ms",
+                         &dev->wave.period_ms);
+    if (dev->wave.period_ms == 0)
+        dev->wave.period_ms = 60000; /* Default one cycle per minute */
+    of_property_read_u32(pdev->dev.of_node, "waveform-noise-mC",
+                         &dev->wave.noise_mC);
+    dev->wave.noise_mC = min_t(u32, dev->wave.noise_mC, 1000000); /* Default 0 */
+
+    cpumask_copy(&dev->gen_cpus, cpu_possible_mask); /* Default anywhere */
+
+    pr_info("simtemp: Configuration:\n");
+    pr_info("  sampling_ms=%u\n", dev->sampling_ms);
+    pr_info("  threshold_mC=%d (%d.%03d°C)\n", 
+            dev->threshold_mC,
+            dev->threshold_mC / 1000, abs(dev->threshold_mC % 1000));
+    pr_info("  base_temp_mC=%d (%d.%03d°C)\n",
+            dev->base_temp_mC,
+            dev->base_temp_mC / 1000, abs(dev->base_temp_mC % 1000));
+    pr_info("  temp_variation_mC=%u (±%u.%03u°C)\n",
+            dev->temp_variation_mC,
+            dev->temp_variation_mC / 1000, dev->temp_variation_mC % 1000);
+    pr_info("  generation_mode=%s\n", simtemp_gen_mode_names[dev->gen_mode]);
+    pr_info("  waveform=%s period_ms=%u noise_mC=%u\n",
+            simtemp_profile_names[dev->wave.profile], dev->wave.period_ms,
+            dev->wave.noise_mC);
+    pr_info("  preroll_samples=%u\n", dev->preroll);
+    pr_info("  align=%d timer_slack_ns=%u\n", dev->align, dev->slack_ns);
+
+    /* Per-CPU event counters */
+    dev->counters = alloc_percpu(struct simtemp_counters);
+    if (!dev->counters) {
+        ret = -ENOMEM;
+        goto err_put;
+    }
+
+    /* Channel array and its ring segments */
+    of_property_read_u32(pdev->dev.of_node, "num-channels", &channels);
+    channels = clamp_t(u32, channels, 1, SIMTEMP_MAX_CHANNELS); /* Default 1 */
+    ret = simtemp_shards_alloc(dev, channels);
+    if (ret)
+        goto err_put;
+    pr_info("  channels=%u shards=%u\n", dev->num_channels, dev->nr_shards);
+
+    /* Initialize wait queue and reader list */
+    init_waitqueue_head(&dev->wait_queue);
+    INIT_LIST_HEAD(&dev->readers);
+    spin_lock_init(&dev->readers_lock);
+    pr_info("simtemp: Wait queue initialized\n");
+
+    /* Replay source, records queued by write() */
+    ret = simtemp_replay_init(dev);
+    if (ret)
+        goto err_put;
+
+    /* Timing histograms (debugfs) */
+    ret = simtemp_stats_init(dev);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to allocate statistics\n");
+        goto err_put;
+    }
+    simtemp_relay_init(dev);
+
+    /* Generation context, timer or thread is set up on start */
+    mutex_init(&dev->gen_lock);
+    dev->timer_interval = ktime_set(0, dev->sampling_ms * 1000000ULL); /* ms to ns */
+    mutex_lock(&dev->gen_lock);
+    simtemp_wave_update(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    /* First instance keeps the historical /dev/simtemp name */
+    dev->id = ida_alloc(&simtemp_ida, GFP_KERNEL);
+    if (dev->id < 0) {
+        ret = dev->id;
+        goto err_put;
+    }
+    if (dev->id == 0)
+        strscpy(dev->name, DEVICE_NAME, sizeof(dev->name));
+    else
+        snprintf(dev->name, sizeof(dev->name), DEVICE_NAME "%d", dev->id);
+
+    /* Register misc device */
+    dev->mdev.minor = MISC_DYNAMIC_MINOR;
+    dev->mdev.name = dev->name;
+    dev->mdev.fops = &simtemp_fops;
+    dev->mdev.groups = simtemp_groups;
+    dev->mdev.parent = &pdev->dev;
+
+    ret = misc_register(&dev->mdev);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to register misc device\n");
+        goto err_ida;
+    }
+
+    /* IIO device next to the misc device */
+    ret = simtemp_iio_init(dev);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to register IIO device\n");
+        goto err_misc;
+    }
+
+    /* Thermal zone, registered disabled */
+    ret = simtemp_thermal_init(dev);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to register thermal zone\n");
+        goto err_iio;
+    }
+
+    /* Sample generation starts with the first consumer: open(), IIO, thermal */
+
+    pr_info("simtemp: Device registered successfully at /dev/%s\n", dev->name);
+
+    return 0;
+
+err_iio:
+    simtemp_iio_exit(dev);
+err_misc:
+    misc_deregister(&dev->mdev);
+err_ida:
+    ida_free(&simtemp_ida, dev->id);
+err_put:
+    simtemp_put(dev);
+    return ret;
+}
+
+static void simtemp_remove(struct platform_device *pdev)
+{
+    struct simtemp_device *dev = platform_get_drvdata(pdev);
+
+    pr_info("simtemp: Removing device\n");
+
+    /* Disables a running IIO buffer, which drops its session */
+    simtemp_iio_exit(dev);
+
+    /* Stop the timer or generation thread, refuse new sessions */
+    mutex_lock(&dev->gen_lock);
+    WRITE_ONCE(dev->dead, true);
+    simtemp_gen_stop(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    /* After the last period, so the zone gets no more updates */
+    simtemp_thermal_exit(dev);
+    simtemp_relay_exit(dev);
+
+    /* Wake up any waiting readers and writers before unregistering */
+    wake_up_interruptible(&dev->wait_queue);
+    wake_up_interruptible(&dev->replay.wait);
+
+    misc_deregister(&dev->mdev);
+    ida_free(&simtemp_ida, dev->id);
+
+    /* Freed here, or when the last open file is closed */
+    simtemp_put(dev);
+
+    pr_info("simtemp: Device removed successfully\n");
+}
+
+/* Device Tree match table */
+static const struct of_device_id simtemp_of_match[] = {
+    { .compatible = "nxp,simtemp", },
+    { }
+};
+MODULE_DEVICE_TABLE(of, simtemp_of_match);
+
+/* Platform driver structure */
+static struct platform_driver simtemp_driver = {
+    .probe = simtemp_probe,
+    .remove = simtemp_remove,
+    .driver = {
+        .name = DRIVER_NAME,
+        .of_match_table = simtemp_of_match,
+    },
+};
+
+/*
+ * Module init/exit
+ */
+
+static struct platform_device **simtemp_pdevs;
+
+static void simtemp_unregister_pdevs(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_instances; i++) {
+        if (!IS_ERR_OR_NULL(simtemp_pdevs[i]))
+            platform_device_unregister(simtemp_pdevs[i]);
+    }
+    kfree(simtemp_pdevs);
+    simtemp_pdevs = NULL;
+}
+
+static int __init nxp_simtemp_init(void)
+{
+    unsigned int i;
+    int ret;
+
+    pr_info("simtemp: Initializing NXP simulated temperature sensor driver\n");
+
+    /* Per-CPU and high priority: shards run right after the tick */
+    simtemp_wq = alloc_workqueue("simtemp", WQ_HIGHPRI, 0);
+    if (!simtemp_wq)
+        return -ENOMEM;
+
+    simtemp_debugfs_init();
+    simtemp_wave_init();
+
+    /* Event multicast group, devices send to it as soon as they probe */
+    ret = simtemp_genl_register();
+    if (ret) {
+        pr_err("simtemp: Failed to register generic netlink family\n");
+        simtemp_debugfs_exit();
+        destroy_workqueue(simtemp_wq);
+        return ret;
+    }
+
+    /* Register platform driver */
+    ret = platform_driver_register(&simtemp_driver);
+    if (ret) {
+        pr_err("simtemp: Failed to register platform driver\n");
+        simtemp_genl_unregister();
+        simtemp_debugfs_exit();
+        destroy_workqueue(simtemp_wq);
+        return ret;
+    }
+
+    /* 
+     * For testing without Device Tree, create platform devices manually.
+     * In production, these would come from Device Tree.
+     */
+    simtemp_pdevs = kcalloc(nr_instances, sizeof(*simtemp_pdevs), GFP_KERNEL);
+    if (!simtemp_pdevs) {
+        ret = -ENOMEM;
+        goto err_driver;
+    }
+
+    for (i = 0; i < nr_instances; i++) {
+        simtemp_pdevs[i] = platform_device_register_simple(DRIVER_NAME,
+                                nr_instances == 1 ? -1 : i, NULL, 0);
+        if (IS_ERR(simtemp_pdevs[i])) {
+            pr_err("simtemp: Failed to register platform device %u\n", i);
+            ret = PTR_ERR(simtemp_pdevs[i]);
+            simtemp_unregister_pdevs();
+            goto err_driver;
+        }
+    }
+
+    /* Runtime created instances (mkdir in configfs) */
+    ret = simtemp_configfs_init();
+    if (ret) {
+        pr_err("simtemp: Failed to register configfs subsystem\n");
+        simtemp_unregister_pdevs();
+        goto err_driver;
+    }
+
+    pr_info("simtemp: Driver initialized successfully\n");
+
+    return 0;
+
+err_driver:
+    platform_driver_unregister(&simtemp_driver);
+    simtemp_genl_unregister();
+    simtemp_debugfs_exit();
+    destroy_workqueue(simtemp_wq);
+    return ret;
+}
+
+static void __exit nxp_simtemp_exit(void)
+{
+    pr_info("simtemp: Exiting driver\n");
+
+    simtemp_configfs_exit();
+    simtemp_unregister_pdevs();
+    platform_driver_unregister(&simtemp_driver);
+    simtemp_genl_unregister();
+    simtemp_debugfs_exit();
+    destroy_workqueue(simtemp_wq);
+
+    /* Readers of closed files are freed by RCU callbacks in this module */
+    rcu_barrier();
+
+    pr_info("simtemp: Driver exited successfully\n");
+}
+
+module_init(nxp_simtemp_init);
+module_exit(nxp_simtemp_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Edgar Valencia");
+MODULE_DESCRIPTION("NXP Simulated Temperature Sensor Driver");
+MODULE_VERSION("0.4");
@@ -0,0 +1,265 @@
+/*
+ * nxp_simtemp_relay.c - Bulk capture through a relay channel
+ *
+ * For offline capture at high rates the generator can copy every
+ * period into a relay channel besides the ring, so capture tools get
+ * per-CPU sub-buffers with mmap and splice instead of read():
+ *
+ *   cd /sys/kernel/debug/nxp_simtemp/<device>/relay
+ *   echo 262144 > subbuf_size; echo 16 > n_subbufs
+ *   echo 2 > format             # SIMTEMP_FORMAT_DELTA, default V2 (1)
+ *   echo 1 > enable
+ *   cat samples0 samples1 ... > capture.bin
+ *
+ * The channel carries raw struct simtemp_sample_v2 records, or with
+ * SIMTEMP_FORMAT_DELTA the same struct simtemp_delta_batch blocks
+ * read() returns, with CLOCK_MONOTONIC timestamps, one file per CPU
+ * that generated them. Each period of a shard is written into the
+ * buffer of the CPU running that shard, as one block of records or as
+ * batches of up to SIMTEMP_READ_BATCH samples, so merging the files by
+ * timestamp restores the stream. subbuf_size is raised to the largest
+ * block if needed. A full buffer drops new blocks, the sampling path
+ * never waits for the consumer.
+ */
+
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/relay.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+
+#include "nxp_simtemp.h"
+
+static struct dentry *simtemp_relay_create_buf_file(const char *filename,
+                                                    struct dentry *parent,
+                                                    umode_t mode,
+                                                    struct rchan_buf *buf,
+                                                    int *is_global)
+{
+    return debugfs_create_file(filename, mode, parent, buf,
+                               &relay_file_operations);
+}
+
+static int simtemp_relay_remove_buf_file(struct dentry *dentry)
+{
+    debugfs_remove(dentry);
+    return 0;
+}
+
+static const struct rchan_callbacks simtemp_relay_callbacks = {
+    .create_buf_file = simtemp_relay_create_buf_file,
+    .remove_buf_file = simtemp_relay_remove_buf_file,
+};
+
+/* Largest delta block: one batch of worst case samples */
+#define SIMTEMP_RELAY_DELTA_SIZE \
+    (sizeof(struct simtemp_delta_batch) + \
+     SIMTEMP_READ_BATCH * SIMTEMP_DELTA_MAX_SAMPLE)
+
+/**
+ * simtemp_relay_write - Copy a generated period into the relay channel
+ * @dev: Device structure
+ * @samples: Samples of one shard for the period
+ * @n: Number of samples
+ *
+ * Called from simtemp_shard_generate() in any generation context. A
+ * delta channel carries its per-CPU encoding buffer as private data,
+ * so the buffer is reached through the RCU protected channel pointer.
+ */
+void simtemp_relay_write(struct simtemp_device *dev,
+                         const struct simtemp_sample_v2 *samples,
+                         unsigned int n)
+{
+    u8 __percpu *scratch;
+    struct rchan *chan;
+    unsigned long flags;
+    unsigned int i, nr;
+    u8 *out;
+
+    rcu_read_lock();
+    chan = rcu_dereference(dev->relay.chan);
+    if (!chan)
+        goto out;
+
+    scratch = (u8 __percpu __force *)chan->private_data;
+    if (!scratch) {
+        relay_write(chan, samples, n * sizeof(*samples));
+        goto out;
+    }
+
+    /* Like relay_write(), own this CPU's buffers with interrupts off */
+    local_irq_save(flags);
+    out = this_cpu_ptr(scratch);
+    for (i = 0; i < n; i += nr) {
+        nr = min_t(unsigned int, n - i, SIMTEMP_READ_BATCH);
+        __relay_write(chan, out,
+                      simtemp_samples_to_delta(samples + i, nr, out));
+    }
+    local_irq_restore(flags);
+out:
+    rcu_read_unlock();
+}
+
+/*
+ * The channel is a consumer of the stream like an open file: enabling
+ * it starts generation, disabling it flushes and removes the files.
+ * Caller must hold dev->gen_lock.
+ */
+static int simtemp_relay_enable(struct simtemp_device *dev)
+{
+    struct simtemp_relay *relay = &dev->relay;
+    u8 __percpu *scratch = NULL;
+    struct rchan *chan;
+    size_t subbuf_size;
+    u32 max_channels = 0;
+    unsigned int k;
+    int ret;
+
+    if (dev->dead)
+        return -ENODEV;
+
+    /*
+     * A raw shard writes its whole period at once, so a sub-buffer must
+     * fit the largest shard. With fewer CPUs than SIMTEMP_SHARD_CHANNELS
+     * slices a shard holds more than that many channels. Delta batches
+     * are bounded by SIMTEMP_READ_BATCH samples instead. The layout is
+     * fixed while the channel holds its session.
+     */
+    switch (relay->format) {
+    case SIMTEMP_FORMAT_V2:
+        for (k = 0; k < dev->nr_shards; k++)
+            max_channels = max(max_channels, dev->shards[k].nr_channels);
+        subbuf_size = max_t(size_t, relay->subbuf_size,
+                            max_channels * sizeof(struct simtemp_sample_v2));
+        break;
+    case SIMTEMP_FORMAT_DELTA:
+        scratch = __alloc_percpu(SIMTEMP_RELAY_DELTA_SIZE, 8);
+        if (!scratch)
+            return -ENOMEM;
+        subbuf_size = max_t(size_t, relay->subbuf_size,
+                            SIMTEMP_RELAY_DELTA_SIZE);
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    chan = relay_open("samples", relay->dir, subbuf_size,
+                      max_t(u32, relay->n_subbufs, 2),
+                      &simtemp_relay_callbacks, (void __force *)scratch);
+    if (!chan) {
+        free_percpu(scratch);
+        return -ENOMEM;
+    }
+
+    ret = simtemp_session_get(dev);
+    if (ret) {
+        relay_close(chan);
+        free_percpu(scratch);
+        return ret;
+    }
+
+    rcu_assign_pointer(relay->chan, chan);
+    relay->enabled = true;
+    pr_info("simtemp: Relay capture enabled (%s, %zu x %u bytes per CPU)\n",
+            scratch ? "delta" : "v2", subbuf_size,
+            max_t(u32, relay->n_subbufs, 2));
+
+    return 0;
+}
+
+static void simtemp_relay_disable(struct simtemp_device *dev)
+{
+    struct simtemp_relay *relay = &dev->relay;
+    u8 __percpu *scratch;
+    struct rchan *chan;
+
+    chan = rcu_replace_pointer(relay->chan, NULL,
+                               lockdep_is_held(&dev->gen_lock));
+    simtemp_session_put(dev);
+    relay->enabled = false;
+
+    /* A period being generated may still write into the channel */
+    synchronize_rcu();
+    scratch = (u8 __percpu __force *)chan->private_data;
+    relay_close(chan);
+    free_percpu(scratch);
+    pr_info("simtemp: Relay capture disabled\n");
+}
+
+static ssize_t simtemp_relay_enable_read(struct file *filp, char __user *buf,
+                                         size_t count, loff_t *ppos)
+{
+    struct simtemp_device *dev = filp->private_data;
+    char val[3] = { READ_ONCE(dev->relay.enabled) ? '1' : '0', '\n', 0 };
+
+    return simple_read_from_buffer(buf, count, ppos, val, 2);
+}
+
+static ssize_t simtemp_relay_enable_write(struct file *filp,
+                                          const char __user *buf,
+                                          size_t count, loff_t *ppos)
+{
+    struct simtemp_device *dev = filp->private_data;
+    bool enable;
+    int ret;
+
+    ret = kstrtobool_from_user(buf, count, &enable);
+    if (ret)
+        return ret;
+
+    mutex_lock(&dev->gen_lock);
+    if (enable && !dev->relay.enabled)
+        ret = simtemp_relay_enable(dev);
+    else if (!enable && dev->relay.enabled)
+        simtemp_relay_disable(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return ret ? ret : count;
+}
+
+static const struct file_operations simtemp_relay_enable_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = simtemp_relay_enable_read,
+    .write = simtemp_relay_enable_write,
+    .llseek = default_llseek,
+};
+
+/**
+ * simtemp_relay_init - Create the relay directory of an instance
+ * @dev: Device structure, statistics already initialized
+ *
+ * Only the knobs are created, the channel and its per-CPU files appear
+ * when capture is enabled. debugfs failures are not fatal.
+ */
+void simtemp_relay_init(struct simtemp_device *dev)
+{
+    struct simtemp_relay *relay = &dev->relay;
+
+    relay->subbuf_size = 256 * 1024;
+    relay->n_subbufs = 8;
+    relay->format = SIMTEMP_FORMAT_V2;
+
+    relay->dir = debugfs_create_dir("relay", dev->stats.debugfs_dir);
+    debugfs_create_file("enable", 0600, relay->dir, dev,
+                        &simtemp_relay_enable_fops);
+    /* Applied when capture is next enabled */
+    debugfs_create_u32("subbuf_size", 0600, relay->dir, &relay->subbuf_size);
+    debugfs_create_u32("n_subbufs", 0600, relay->dir, &relay->n_subbufs);
+    debugfs_create_u32("format", 0600, relay->dir, &relay->format);
+}
+
+/**
+ * simtemp_relay_exit - Close an enabled channel
+ * @dev: Device structure
+ *
+ * Called once the device is dead and generation has stopped for good.
+ * The directory goes away with the statistics.
+ */
+void simtemp_relay_exit(struct simtemp_device *dev)
+{
+    mutex_lock(&dev->gen_lock);
+    if (dev->relay.enabled)
+        simtemp_relay_disable(dev);
+    mutex_unlock(&dev->gen_lock);
+}
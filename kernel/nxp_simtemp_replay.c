@@ -0,0 +1,431 @@
+/*
+ * nxp_simtemp_replay.c - Recorded sample replay for nxp_simtemp
+ *
+ * With source set to "replay" the sample values come from a recorded
+ * trace instead of the random generator. A trace file is loaded with
+ * request_firmware() and played first, after that records written to
+ * the device with write() are played as they arrive:
+ *
+ *   echo replay > /sys/class/misc/simtemp/source
+ *   echo simtemp-trace.bin > /sys/class/misc/simtemp/replay/firmware
+ *   echo 10 > /sys/class/misc/simtemp/replay/speed    (10x faster)
+ *   cat capture.bin > /dev/simtemp
+ *
+ * Records use the v1 read() layout, so the output of one device can be
+ * fed straight back into another. A dedicated thread paces them by the
+ * distance between their timestamps divided by the speed and runs the
+ * normal tick, so readers, flags and counters see no difference.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/kfifo.h>
+#include <linux/firmware.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include "nxp_simtemp.h"
+
+/* Records write() may queue ahead of the replay thread (power of 2) */
+#define SIMTEMP_REPLAY_FIFO 1024
+
+/**
+ * simtemp_replay_sleep - Wait for the due time of the next record
+ * @dev: Device structure
+ * @due: Absolute CLOCK_MONOTONIC time
+ *
+ * Returns: true once @due is reached, false if the thread must stop
+ */
+static bool simtemp_replay_sleep(struct simtemp_device *dev, ktime_t due)
+{
+    while (!kthread_should_stop()) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop()) {
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+        if (!schedule_hrtimeout_range(&due, READ_ONCE(dev->slack_ns),
+                                      HRTIMER_MODE_ABS))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * simtemp_replay_thread - Play the trace, then the written records
+ * @data: Device structure
+ *
+ * Each record is due its timestamp distance to the previous one,
+ * divided by the speed, after that one. The clock restarts from now
+ * on the first record, after the queue ran dry, at maximum speed and
+ * when timestamps go backwards.
+ *
+ * Paced playback runs SCHED_FIFO. At maximum speed nothing sleeps
+ * between records, so the thread drops to SCHED_NORMAL for as long as
+ * that lasts rather than hog its CPU with only cond_resched().
+ */
+static int simtemp_replay_thread(void *data)
+{
+    struct simtemp_device *dev = data;
+    struct simtemp_replay *rp = &dev->replay;
+    struct simtemp_sample rec;
+    bool have_prev = false;
+    bool fifo = false;
+    u64 prev_ts = 0;
+    u32 skip = 0;
+    ktime_t due = 0;
+    u32 pos = 0;
+    u32 speed;
+
+    while (!kthread_should_stop()) {
+        if (pos < rp->trace_len) {
+            rec = rp->trace[pos++];
+        } else if (kfifo_get(&rp->fifo, &rec)) {
+            /* Room for blocked writers */
+            wake_up_interruptible(&rp->wait);
+        } else {
+            have_prev = false;
+            wait_event_interruptible(rp->wait, kthread_should_stop() ||
+                                     !kfifo_is_empty(&rp->fifo));
+            continue;
+        }
+
+        speed = READ_ONCE(rp->speed);
+        if (fifo != !!speed) {
+            fifo = !!speed;
+            if (fifo)
+                sched_set_fifo(current);
+            else
+                sched_set_normal(current, 0);
+        }
+
+        if (!have_prev || !speed || rec.timestamp_ns < prev_ts)
+            due = ktime_get();
+        else
+            due = ktime_add_ns(due, div_u64(rec.timestamp_ns - prev_ts, speed));
+        prev_ts = rec.timestamp_ns;
+        have_prev = true;
+
+        if (speed && !simtemp_replay_sleep(dev, due))
+            break;
+
+        /* Adaptive rate: one record out of rate_divider reaches the tick */
+        if (skip) {
+            skip--;
+            continue;
+        }
+        skip = (1U << READ_ONCE(dev->rate_shift)) - 1;
+
+        WRITE_ONCE(rp->temp_mC, rec.temp_mC);
+        simtemp_tick(dev, due);
+        cond_resched();
+    }
+
+    return 0;
+}
+
+/**
+ * simtemp_replay_start - Start the replay thread
+ * @dev: Device structure
+ *
+ * Caller must hold dev->gen_lock.
+ *
+ * Returns: 0 on success, negative errno if the thread cannot be created
+ */
+int simtemp_replay_start(struct simtemp_device *dev)
+{
+    struct task_struct *task;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    task = kthread_create(simtemp_replay_thread, dev, "simtemp-replay/%s",
+                          dev_name(&dev->pdev->dev));
+    if (IS_ERR(task))
+        return PTR_ERR(task);
+
+    set_cpus_allowed_ptr(task, &dev->gen_cpus);
+    wake_up_process(task);
+    dev->replay.thread = task;
+
+    return 0;
+}
+
+/**
+ * simtemp_replay_stop - Stop the replay thread
+ * @dev: Device structure
+ *
+ * Records still queued by write() belong to the ending session and are
+ * dropped. Caller must hold dev->gen_lock.
+ */
+void simtemp_replay_stop(struct simtemp_device *dev)
+{
+    struct simtemp_replay *rp = &dev->replay;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    if (!rp->thread)
+        return;
+
+    kthread_stop(rp->thread);
+    rp->thread = NULL;
+
+    mutex_lock(&rp->write_lock);
+    kfifo_reset(&rp->fifo);
+    mutex_unlock(&rp->write_lock);
+    wake_up_interruptible(&rp->wait);
+}
+
+/**
+ * simtemp_replay_write - Queue records for replay
+ * @filp: File pointer
+ * @buf: Array of struct simtemp_sample
+ * @count: Size of @buf, a multiple of the record size
+ * @ppos: Unused
+ *
+ * Blocks while the queue is full unless the file is non-blocking.
+ * Short writes happen when only part of @buf fits.
+ *
+ * Returns: bytes queued, or negative errno
+ */
+ssize_t simtemp_replay_write(struct file *filp, const char __user *buf,
+                             size_t count, loff_t *ppos)
+{
+    struct simtemp_reader *reader = filp->private_data;
+    struct simtemp_device *dev = reader->dev;
+    struct simtemp_replay *rp = &dev->replay;
+    unsigned int copied;
+    int ret;
+
+    if (READ_ONCE(dev->source) != SIMTEMP_SRC_REPLAY)
+        return -EINVAL;
+    if (count % sizeof(struct simtemp_sample))
+        return -EINVAL;
+    if (!count)
+        return 0;
+
+    if (mutex_lock_interruptible(&rp->write_lock))
+        return -ERESTARTSYS;
+
+    while (kfifo_is_full(&rp->fifo)) {
+        mutex_unlock(&rp->write_lock);
+
+        if (READ_ONCE(dev->dead))
+            return -ENODEV;
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        ret = wait_event_interruptible(rp->wait,
+                                       !kfifo_is_full(&rp->fifo) ||
+                                       READ_ONCE(dev->dead));
+        if (ret)
+            return ret;
+
+        if (mutex_lock_interruptible(&rp->write_lock))
+            return -ERESTARTSYS;
+    }
+
+    ret = kfifo_from_user(&rp->fifo, buf, count, &copied);
+    mutex_unlock(&rp->write_lock);
+
+    if (copied)
+        wake_up_interruptible(&rp->wait);
+
+    return copied ? copied : ret;
+}
+
+/*
+ * sysfs attributes (/sys/class/misc/simtemp/replay/)
+ */
+
+/* "original", "max" (no delays) or a speed-up factor */
+static ssize_t speed_show(struct device *d, struct device_attribute *attr,
+                          char *buf)
+{
+    u32 speed = READ_ONCE(simtemp_from_sysfs(d)->replay.speed);
+
+    if (!speed)
+        return sysfs_emit(buf, "max\n");
+    if (speed == 1)
+        return sysfs_emit(buf, "original\n");
+    return sysfs_emit(buf, "%u\n", speed);
+}
+
+static ssize_t speed_store(struct device *d, struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+    u32 val;
+    int ret;
+
+    if (sysfs_streq(buf, "original")) {
+        val = 1;
+    } else if (sysfs_streq(buf, "max")) {
+        val = 0;
+    } else {
+        ret = kstrtou32(buf, 0, &val);
+        if (ret)
+            return ret;
+        if (!val)
+            return -EINVAL;
+    }
+
+    /* Picked up by the replay thread with the next record */
+    WRITE_ONCE(simtemp_from_sysfs(d)->replay.speed, val);
+    return count;
+}
+static DEVICE_ATTR_RW(speed);
+
+static ssize_t firmware_show(struct device *d, struct device_attribute *attr,
+                             char *buf)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    ssize_t len;
+
+    mutex_lock(&dev->gen_lock);
+    len = sysfs_emit(buf, "%s %u\n", dev->replay.trace ? dev->replay.fw_name :
+                     "none", dev->replay.trace_len);
+    mutex_unlock(&dev->gen_lock);
+
+    return len;
+}
+
+/**
+ * simtemp_replay_load - Read and validate a trace file
+ * @dev: Device structure
+ * @name: Firmware file name
+ * @len: Returns the number of records
+ *
+ * Returns: kvmalloc'ed records, or ERR_PTR
+ */
+static struct simtemp_sample *simtemp_replay_load(struct simtemp_device *dev,
+                                                  const char *name, u32 *len)
+{
+    const struct simtemp_trace_header *hdr;
+    struct simtemp_sample *trace;
+    const struct firmware *fw;
+    int ret;
+
+    ret = request_firmware(&fw, name, &dev->pdev->dev);
+    if (ret)
+        return ERR_PTR(ret);
+
+    hdr = (const void *)fw->data;
+    if (fw->size < sizeof(*hdr) ||
+        hdr->magic != SIMTEMP_TRACE_MAGIC ||
+        hdr->version != SIMTEMP_TRACE_VERSION ||
+        !hdr->count ||
+        hdr->count != (fw->size - sizeof(*hdr)) / sizeof(*trace) ||
+        (fw->size - sizeof(*hdr)) % sizeof(*trace)) {
+        dev_err(&dev->pdev->dev, "Invalid replay trace %s\n", name);
+        trace = ERR_PTR(-EINVAL);
+        goto out;
+    }
+
+    trace = kvmalloc_array(hdr->count, sizeof(*trace), GFP_KERNEL);
+    if (!trace) {
+        trace = ERR_PTR(-ENOMEM);
+        goto out;
+    }
+    memcpy(trace, hdr + 1, hdr->count * sizeof(*trace));
+    *len = hdr->count;
+
+out:
+    release_firmware(fw);
+    return trace;
+}
+
+/* Loads a trace file ("none" unloads), a running replay starts over */
+static ssize_t firmware_store(struct device *d, struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    struct simtemp_replay *rp = &dev->replay;
+    struct simtemp_sample *trace = NULL, *old;
+    char name[sizeof(rp->fw_name)];
+    bool restart;
+    u32 len = 0;
+    int ret = 0;
+
+    if (strscpy(name, buf, sizeof(name)) < 0)
+        return -EINVAL;
+    strim(name);
+    if (!*name)
+        return -EINVAL;
+
+    if (strcmp(name, "none")) {
+        trace = simtemp_replay_load(dev, name, &len);
+        if (IS_ERR(trace))
+            return PTR_ERR(trace);
+    }
+
+    mutex_lock(&dev->gen_lock);
+    restart = rp->thread;
+    if (restart)
+        simtemp_replay_stop(dev);
+
+    old = rp->trace;
+    rp->trace = trace;
+    rp->trace_len = len;
+    strscpy(rp->fw_name, name, sizeof(rp->fw_name));
+
+    if (restart)
+        ret = simtemp_replay_start(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    kvfree(old);
+    if (trace)
+        pr_info("simtemp: Loaded replay trace %s (%u samples)\n", name, len);
+
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(firmware);
+
+static ssize_t queued_show(struct device *d, struct device_attribute *attr,
+                           char *buf)
+{
+    return sysfs_emit(buf, "%u\n",
+                      kfifo_len(&simtemp_from_sysfs(d)->replay.fifo));
+}
+static DEVICE_ATTR_RO(queued);
+
+static struct attribute *simtemp_replay_attrs[] = {
+    &dev_attr_speed.attr,
+    &dev_attr_firmware.attr,
+    &dev_attr_queued.attr,
+    NULL,
+};
+
+const struct attribute_group simtemp_replay_group = {
+    .name = "replay",
+    .attrs = simtemp_replay_attrs,
+};
+
+/**
+ * simtemp_replay_init - Set up the write() queue
+ * @dev: Device structure
+ *
+ * Returns: 0 on success, -ENOMEM on allocation failure
+ */
+int simtemp_replay_init(struct simtemp_device *dev)
+{
+    struct simtemp_replay *rp = &dev->replay;
+
+    mutex_init(&rp->write_lock);
+    init_waitqueue_head(&rp->wait);
+    rp->speed = 1;
+
+    return kfifo_alloc(&rp->fifo, SIMTEMP_REPLAY_FIFO, GFP_KERNEL);
+}
+
+/* Safe on a zeroed structure, the thread must already be stopped */
+void simtemp_replay_exit(struct simtemp_device *dev)
+{
+    kfifo_free(&dev->replay.fifo);
+    kvfree(dev->replay.trace);
+    dev->replay.trace = NULL;
+}
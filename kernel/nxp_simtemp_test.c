@@ -0,0 +1,468 @@
+/*
+ * nxp_simtemp_test.c - KUnit tests and microbenchmarks for nxp_simtemp
+ *
+ * Covers the broadcast ring (wraparound, overwrite accounting, the
+ * until_ns bound, a concurrent producer and consumer) and the sample
+ * generator (range, threshold and period flags, sources). The slow
+ * cases time put/get and generate loops and report ns/op, next to a
+ * kfifo carrying the same records, so ring changes can be measured:
+ *
+ *   make -C kernel test
+ *   insmod kernel/nxp_simtemp.ko
+ *   cat /sys/kernel/debug/kunit/nxp_simtemp_ring/results
+ *
+ * Built into the module only with SIMTEMP_KUNIT=y on kernels with
+ * CONFIG_KUNIT, the suites then run when the module is loaded.
+ */
+
+#include <kunit/test.h>
+#include <linux/kernel.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/math64.h>
+
+#include "nxp_simtemp.h"
+
+#define SIMTEMP_TEST_RING_SIZE  8
+#define SIMTEMP_TEST_BENCH_OPS  100000
+
+/*
+ * Ring buffer fixture
+ */
+
+struct simtemp_ring_test {
+    struct simtemp_ring_buffer ring;
+    struct simtemp_counters __percpu *counters;
+    struct simtemp_sample_v2 *storage;
+    u32 size;
+};
+
+static struct simtemp_ring_test *simtemp_ring_test_alloc(struct kunit *test,
+                                                         u32 size)
+{
+    struct simtemp_ring_test *rt;
+
+    rt = kunit_kzalloc(test, sizeof(*rt), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, rt);
+    rt->storage = kunit_kcalloc(test, size, sizeof(*rt->storage), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, rt->storage);
+    rt->counters = alloc_percpu(struct simtemp_counters);
+    KUNIT_ASSERT_NOT_NULL(test, rt->counters);
+
+    rt->size = size;
+    ring_buffer_init(&rt->ring, rt->storage, size, rt->counters);
+    test->priv = rt;
+
+    return rt;
+}
+
+static void simtemp_ring_test_exit(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = test->priv;
+
+    if (rt)
+        free_percpu(rt->counters);
+}
+
+static u64 simtemp_test_overwritten(struct simtemp_ring_test *rt)
+{
+    u64 sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        sum += per_cpu_ptr(rt->counters, cpu)->overwritten;
+
+    return sum;
+}
+
+/* Put @n samples stamped with their sequence numbers, starting at @seq */
+static void simtemp_test_put_seq(struct simtemp_ring_test *rt, u64 seq,
+                                 unsigned int n)
+{
+    struct simtemp_sample_v2 s[SIMTEMP_TEST_RING_SIZE] = { };
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        s[i].timestamp_ns = seq + i;
+        s[i].temp_mC = (s32)(seq + i);
+    }
+    ring_buffer_put(&rt->ring, s, n);
+}
+
+static void simtemp_ring_test_empty(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test,
+                                                           SIMTEMP_TEST_RING_SIZE);
+    struct simtemp_sample_v2 out[4];
+    u64 cursor = 0, seq, lost, ts;
+
+    KUNIT_EXPECT_FALSE(test, ring_buffer_peek(&rt->ring, &cursor, &ts, &lost));
+    KUNIT_EXPECT_EQ(test, lost, 0);
+    KUNIT_EXPECT_EQ(test, ring_buffer_get(&rt->ring, &cursor, out, 4, U64_MAX,
+                                          &seq, &lost), 0);
+    KUNIT_EXPECT_EQ(test, cursor, 0);
+}
+
+static void simtemp_ring_test_wraparound(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test,
+                                                           SIMTEMP_TEST_RING_SIZE);
+    struct simtemp_sample_v2 out[SIMTEMP_TEST_RING_SIZE];
+    u64 cursor = 0, seq, lost;
+    unsigned int n, i, round;
+
+    /* Consume in step with the producer across several wraps */
+    for (round = 0; round < 5; round++) {
+        simtemp_test_put_seq(rt, round * 5, 5);
+
+        n = ring_buffer_get(&rt->ring, &cursor, out, ARRAY_SIZE(out), U64_MAX,
+                            &seq, &lost);
+        KUNIT_ASSERT_EQ(test, n, 5);
+        KUNIT_EXPECT_EQ(test, lost, 0);
+        KUNIT_EXPECT_EQ(test, seq, round * 5);
+        for (i = 0; i < n; i++)
+            KUNIT_EXPECT_EQ(test, out[i].timestamp_ns, seq + i);
+    }
+    KUNIT_EXPECT_EQ(test, cursor, 25);
+    KUNIT_EXPECT_EQ(test, rt->ring.head, 25);
+    /* Recycled slots count even when every reader kept up */
+    KUNIT_EXPECT_EQ(test, simtemp_test_overwritten(rt), 25 - 8);
+}
+
+static void simtemp_ring_test_overwrite(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test,
+                                                           SIMTEMP_TEST_RING_SIZE);
+    struct simtemp_sample_v2 out[SIMTEMP_TEST_RING_SIZE];
+    u64 cursor = 0, seq, lost, ts;
+    unsigned int n, i;
+
+    /* 20 samples into 8 slots: the reader at 0 loses the first 12 */
+    simtemp_test_put_seq(rt, 0, 8);
+    simtemp_test_put_seq(rt, 8, 8);
+    simtemp_test_put_seq(rt, 16, 4);
+    KUNIT_EXPECT_EQ(test, simtemp_test_overwritten(rt), 12);
+
+    KUNIT_ASSERT_TRUE(test, ring_buffer_peek(&rt->ring, &cursor, &ts, &lost));
+    KUNIT_EXPECT_EQ(test, lost, 12);
+    KUNIT_EXPECT_EQ(test, cursor, 12);
+    KUNIT_EXPECT_EQ(test, ts, 12);
+
+    n = ring_buffer_get(&rt->ring, &cursor, out, ARRAY_SIZE(out), U64_MAX,
+                        &seq, &lost);
+    KUNIT_EXPECT_EQ(test, lost, 0);
+    KUNIT_ASSERT_EQ(test, n, 8);
+    KUNIT_EXPECT_EQ(test, seq, 12);
+    for (i = 0; i < n; i++)
+        KUNIT_EXPECT_EQ(test, out[i].timestamp_ns, 12 + i);
+
+    /* Each reader reports its own loss, the counter has each drop once */
+    cursor = 3;
+    n = ring_buffer_get(&rt->ring, &cursor, out, 1, U64_MAX, &seq, &lost);
+    KUNIT_EXPECT_EQ(test, n, 1);
+    KUNIT_EXPECT_EQ(test, lost, 9);
+    KUNIT_EXPECT_EQ(test, simtemp_test_overwritten(rt), 12);
+}
+
+static void simtemp_ring_test_until(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test,
+                                                           SIMTEMP_TEST_RING_SIZE);
+    struct simtemp_sample_v2 out[SIMTEMP_TEST_RING_SIZE];
+    u64 cursor = 0, seq, lost;
+
+    simtemp_test_put_seq(rt, 0, 6);
+
+    /* Samples stamped after until_ns stay queued */
+    KUNIT_EXPECT_EQ(test, ring_buffer_get(&rt->ring, &cursor, out,
+                                          ARRAY_SIZE(out), 2, &seq, &lost), 3);
+    KUNIT_EXPECT_EQ(test, cursor, 3);
+    KUNIT_EXPECT_EQ(test, ring_buffer_get(&rt->ring, &cursor, out, 2, U64_MAX,
+                                          &seq, &lost), 2);
+    KUNIT_EXPECT_EQ(test, out[1].timestamp_ns, 4);
+    KUNIT_EXPECT_EQ(test, cursor, 5);
+}
+
+/* Concurrent producer: one sample per put, stamped with its sequence */
+#define SIMTEMP_TEST_CONC_TOTAL 200000
+
+struct simtemp_conc {
+    struct simtemp_ring_test *rt;
+    struct completion done;
+};
+
+static int simtemp_test_producer(void *data)
+{
+    struct simtemp_conc *conc = data;
+    u64 seq;
+
+    for (seq = 0; seq < SIMTEMP_TEST_CONC_TOTAL; seq++) {
+        simtemp_test_put_seq(conc->rt, seq, 1);
+        if (!(seq & 1023))
+            cond_resched();
+    }
+    complete(&conc->done);
+
+    return 0;
+}
+
+static void simtemp_ring_test_concurrent(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test, 64);
+    struct simtemp_sample_v2 out[16];
+    u64 cursor = 0, seq, lost, consumed = 0, overflows = 0;
+    struct task_struct *task;
+    struct simtemp_conc conc;
+    unsigned int n, i;
+    bool ordered = true;
+
+    conc.rt = rt;
+    init_completion(&conc.done);
+    task = kthread_run(simtemp_test_producer, &conc, "simtemp-kunit");
+    KUNIT_ASSERT_FALSE(test, IS_ERR(task));
+
+    while (cursor < SIMTEMP_TEST_CONC_TOTAL) {
+        n = ring_buffer_get(&rt->ring, &cursor, out, ARRAY_SIZE(out), U64_MAX,
+                            &seq, &lost);
+        overflows += lost;
+        for (i = 0; i < n; i++)
+            ordered &= out[i].timestamp_ns == seq + i;
+        consumed += n;
+        if (!n)
+            cond_resched();
+    }
+    wait_for_completion(&conc.done);
+
+    /* Every sample is either delivered once, in order, or counted lost */
+    KUNIT_EXPECT_TRUE(test, ordered);
+    KUNIT_EXPECT_EQ(test, consumed + overflows, SIMTEMP_TEST_CONC_TOTAL);
+    /* Everything but the last ring full was dropped, read or not */
+    KUNIT_EXPECT_EQ(test, simtemp_test_overwritten(rt),
+                    SIMTEMP_TEST_CONC_TOTAL - 64);
+    KUNIT_EXPECT_LE(test, overflows, simtemp_test_overwritten(rt));
+    kunit_info(test, "consumed %llu, lost %llu\n", consumed, overflows);
+}
+
+/*
+ * Generator fixture
+ */
+
+static struct simtemp_device *simtemp_gen_test_alloc(struct kunit *test)
+{
+    struct simtemp_device *dev;
+
+    dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, dev);
+
+    dev->mdev.name = "simtemp-kunit";
+    dev->base_temp_mC = 25000;
+    dev->temp_variation_mC = 5000;
+    dev->threshold_mC = 27000;
+    dev->source = SIMTEMP_SRC_RANDOM;
+    dev->wave.profile = SIMTEMP_PROFILE_NOISE;
+
+    return dev;
+}
+
+static void simtemp_gen_test_noise(struct kunit *test)
+{
+    struct simtemp_device *dev = simtemp_gen_test_alloc(test);
+    struct simtemp_sample_v2 s;
+    unsigned int i, above = 0;
+    bool in_range = true, flags_ok = true;
+
+    for (i = 0; i < 10000; i++) {
+        simtemp_generate_sample(dev, &s, i, i + 1000, 7, 0);
+        in_range &= s.temp_mC >= 20000 && s.temp_mC <= 30000;
+        flags_ok &= !!(s.flags & SIMTEMP_FLAG_THRESHOLD_EXCEEDED) ==
+                    (s.temp_mC > dev->threshold_mC);
+        flags_ok &= !!(s.flags & SIMTEMP_FLAG_NEW_SAMPLE);
+        above += s.temp_mC > dev->threshold_mC;
+    }
+
+    KUNIT_EXPECT_TRUE(test, in_range);
+    KUNIT_EXPECT_TRUE(test, flags_ok);
+    /* 3000 of 10001 values are above: both outcomes must show up */
+    KUNIT_EXPECT_GT(test, above, 0);
+    KUNIT_EXPECT_LT(test, above, 10000);
+
+    KUNIT_EXPECT_EQ(test, s.timestamp_ns, 9999);
+    KUNIT_EXPECT_EQ(test, s.wall_ns, 10999);
+    KUNIT_EXPECT_EQ(test, s.channel, 7);
+}
+
+static void simtemp_gen_test_zero_variation(struct kunit *test)
+{
+    struct simtemp_device *dev = simtemp_gen_test_alloc(test);
+    struct simtemp_sample_v2 s;
+
+    dev->temp_variation_mC = 0;
+    dev->threshold_mC = dev->base_temp_mC;
+    simtemp_generate_sample(dev, &s, 0, 0, 0, 0);
+
+    /* Exceeding means strictly above the threshold */
+    KUNIT_EXPECT_EQ(test, s.temp_mC, 25000);
+    KUNIT_EXPECT_EQ(test, s.flags, SIMTEMP_FLAG_NEW_SAMPLE);
+}
+
+static void simtemp_gen_test_replay(struct kunit *test)
+{
+    struct simtemp_device *dev = simtemp_gen_test_alloc(test);
+    struct simtemp_sample_v2 s;
+
+    dev->source = SIMTEMP_SRC_REPLAY;
+    dev->replay.temp_mC = 50000;
+    dev->period_flags = SIMTEMP_FLAG_RATE_CHANGE;
+    dev->tick_seq = 0x100000042ULL;
+    simtemp_generate_sample(dev, &s, 0, 0, 0, 0);
+
+    KUNIT_EXPECT_EQ(test, s.temp_mC, 50000);
+    KUNIT_EXPECT_EQ(test, s.flags, SIMTEMP_FLAG_NEW_SAMPLE |
+                                   SIMTEMP_FLAG_RATE_CHANGE |
+                                   SIMTEMP_FLAG_THRESHOLD_EXCEEDED);
+    KUNIT_EXPECT_EQ(test, s.seq, 0x42);
+}
+
+static void simtemp_gen_test_wave(struct kunit *test)
+{
+    struct simtemp_device *dev = simtemp_gen_test_alloc(test);
+    struct simtemp_sample_v2 s;
+    unsigned int i;
+
+    /* The unit tables are __init, fill the device table directly */
+    dev->wave.profile = SIMTEMP_PROFILE_RAMP;
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++)
+        dev->wave.table[i] = i;
+
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i += 97) {
+        simtemp_generate_sample(dev, &s, 0, 0, 0,
+                                i << (32 - SIMTEMP_WAVE_BITS));
+        KUNIT_EXPECT_EQ(test, s.temp_mC, 25000 + (s32)i);
+    }
+}
+
+/*
+ * Microbenchmarks, reported as ns/op
+ */
+
+static void simtemp_bench_report(struct kunit *test, const char *what,
+                                 u64 start_ns, u64 ops)
+{
+    u64 ns = ktime_get_ns() - start_ns, rem, whole;
+
+    whole = div64_u64_rem(ns, ops, &rem);
+    kunit_info(test, "%-24s %6llu.%02llu ns/op\n", what, whole,
+               div64_u64(rem * 100, ops));
+}
+
+static void simtemp_bench_ring(struct kunit *test)
+{
+    struct simtemp_ring_test *rt = simtemp_ring_test_alloc(test,
+                                                           RING_BUFFER_SIZE);
+    struct simtemp_sample_v2 s = { .flags = SIMTEMP_FLAG_NEW_SAMPLE }, out[16];
+    u64 cursor = 0, seq, lost, start, i;
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS; i++)
+        ring_buffer_put(&rt->ring, &s, 1);
+    simtemp_bench_report(test, "ring put x1", start, SIMTEMP_TEST_BENCH_OPS);
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS; i++) {
+        ring_buffer_put(&rt->ring, &s, 1);
+        ring_buffer_get(&rt->ring, &cursor, out, 1, U64_MAX, &seq, &lost);
+    }
+    simtemp_bench_report(test, "ring put+get x1", start, SIMTEMP_TEST_BENCH_OPS);
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS / 16; i++) {
+        ring_buffer_put(&rt->ring, out, 16);
+        ring_buffer_get(&rt->ring, &cursor, out, 16, U64_MAX, &seq, &lost);
+    }
+    simtemp_bench_report(test, "ring put+get x16 /sample", start,
+                         SIMTEMP_TEST_BENCH_OPS / 16 * 16);
+}
+
+/* Single consumer baseline: a kfifo of the same records, same locking */
+static void simtemp_bench_kfifo(struct kunit *test)
+{
+    DECLARE_KFIFO_PTR(fifo, struct simtemp_sample_v2);
+    struct simtemp_sample_v2 s = { .flags = SIMTEMP_FLAG_NEW_SAMPLE }, out[16];
+    spinlock_t lock;
+    u64 start, i;
+
+    spin_lock_init(&lock);
+    KUNIT_ASSERT_EQ(test, kfifo_alloc(&fifo, RING_BUFFER_SIZE, GFP_KERNEL), 0);
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS; i++) {
+        kfifo_in_spinlocked(&fifo, &s, 1, &lock);
+        kfifo_out_spinlocked(&fifo, out, 1, &lock);
+    }
+    simtemp_bench_report(test, "kfifo in+out x1", start, SIMTEMP_TEST_BENCH_OPS);
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS / 16; i++) {
+        kfifo_in_spinlocked(&fifo, out, 16, &lock);
+        kfifo_out_spinlocked(&fifo, out, 16, &lock);
+    }
+    simtemp_bench_report(test, "kfifo in+out x16 /sample", start,
+                         SIMTEMP_TEST_BENCH_OPS / 16 * 16);
+
+    kfifo_free(&fifo);
+}
+
+static void simtemp_bench_generate(struct kunit *test)
+{
+    struct simtemp_device *dev = simtemp_gen_test_alloc(test);
+    struct simtemp_sample_v2 s;
+    u64 start, i;
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS; i++)
+        simtemp_generate_sample(dev, &s, i, i, 0, 0);
+    simtemp_bench_report(test, "generate noise", start, SIMTEMP_TEST_BENCH_OPS);
+
+    dev->wave.profile = SIMTEMP_PROFILE_SINE;
+    start = ktime_get_ns();
+    for (i = 0; i < SIMTEMP_TEST_BENCH_OPS; i++)
+        simtemp_generate_sample(dev, &s, i, i, 0, i * SIMTEMP_WAVE_SPREAD);
+    simtemp_bench_report(test, "generate wave", start, SIMTEMP_TEST_BENCH_OPS);
+}
+
+static struct kunit_case simtemp_ring_test_cases[] = {
+    KUNIT_CASE(simtemp_ring_test_empty),
+    KUNIT_CASE(simtemp_ring_test_wraparound),
+    KUNIT_CASE(simtemp_ring_test_overwrite),
+    KUNIT_CASE(simtemp_ring_test_until),
+    KUNIT_CASE_SLOW(simtemp_ring_test_concurrent),
+    KUNIT_CASE_SLOW(simtemp_bench_ring),
+    KUNIT_CASE_SLOW(simtemp_bench_kfifo),
+    {}
+};
+
+static struct kunit_suite simtemp_ring_test_suite = {
+    .name = "nxp_simtemp_ring",
+    .exit = simtemp_ring_test_exit,
+    .test_cases = simtemp_ring_test_cases,
+};
+
+static struct kunit_case simtemp_gen_test_cases[] = {
+    KUNIT_CASE(simtemp_gen_test_noise),
+    KUNIT_CASE(simtemp_gen_test_zero_variation),
+    KUNIT_CASE(simtemp_gen_test_replay),
+    KUNIT_CASE(simtemp_gen_test_wave),
+    KUNIT_CASE_SLOW(simtemp_bench_generate),
+    {}
+};
+
+static struct kunit_suite simtemp_gen_test_suite = {
+    .name = "nxp_simtemp_generator",
+    .test_cases = simtemp_gen_test_cases,
+};
+
+kunit_test_suites(&simtemp_ring_test_suite, &simtemp_gen_test_suite);
@@ -0,0 +1,201 @@
+/*
+ * nxp_simtemp_thermal.c - Thermal zone for nxp_simtemp
+ *
+ * Every instance registers a thermal zone named after its device, so
+ * kernel governors and cooling devices can be exercised against the
+ * simulated sensor:
+ *
+ *   echo enabled > /sys/class/thermal/thermal_zoneX/mode
+ *   cat /sys/class/thermal/thermal_zoneX/temp
+ *   echo 50000 > /sys/class/thermal/thermal_zoneX/trip_point_0_temp
+ *
+ * The zone reports channel 0 and has a single passive trip point at
+ * threshold_mC, kept in sync whichever side changes it. It does not
+ * poll: the sampling path detects threshold crossings and periods above
+ * it and has the zone updated from a work item.
+ */
+
+#include <linux/kernel.h>
+#include <linux/thermal.h>
+#include <linux/workqueue.h>
+
+#include "nxp_simtemp.h"
+
+static int simtemp_thermal_get_temp(struct thermal_zone_device *tz, int *temp)
+{
+    struct simtemp_device *dev = thermal_zone_device_priv(tz);
+
+    /* No sample until the zone (or a reader) started generation */
+    if (!READ_ONCE(dev->thermal.valid))
+        return -EAGAIN;
+
+    *temp = READ_ONCE(dev->thermal.temp_mC);
+    return 0;
+}
+
+/* The trip point and the sample flag threshold are the same value */
+static int simtemp_thermal_set_trip_temp(struct thermal_zone_device *tz,
+                                         const struct thermal_trip *trip,
+                                         int temp)
+{
+    struct simtemp_device *dev = thermal_zone_device_priv(tz);
+
+    /* Called under the zone lock, the core moves the trip itself */
+    __simtemp_set_threshold(dev, temp);
+    return 0;
+}
+
+/* An enabled zone is a consumer of the stream, like an open file */
+static int simtemp_thermal_change_mode(struct thermal_zone_device *tz,
+                                       enum thermal_device_mode mode)
+{
+    struct simtemp_device *dev = thermal_zone_device_priv(tz);
+    bool enable = mode == THERMAL_DEVICE_ENABLED;
+    int ret = 0;
+
+    mutex_lock(&dev->gen_lock);
+    if (enable != dev->thermal.enabled) {
+        if (!enable)
+            simtemp_session_put(dev);
+        else if (dev->dead)
+            ret = -ENODEV;
+        else
+            ret = simtemp_session_get(dev);
+        if (!ret)
+            dev->thermal.enabled = enable;
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    return ret;
+}
+
+static const struct thermal_zone_device_ops simtemp_thermal_ops = {
+    .get_temp = simtemp_thermal_get_temp,
+    .set_trip_temp = simtemp_thermal_set_trip_temp,
+    .change_mode = simtemp_thermal_change_mode,
+};
+
+static void simtemp_thermal_work(struct work_struct *work)
+{
+    struct simtemp_thermal *th = container_of(work, struct simtemp_thermal,
+                                              work);
+
+    thermal_zone_device_update(th->tz, THERMAL_EVENT_UNSPECIFIED);
+}
+
+/**
+ * simtemp_thermal_push - Hand a new period to the thermal zone
+ * @dev: Device structure
+ * @temp_mC: Channel 0 value of the period
+ *
+ * Called from simtemp_publish() in any generation context. A crossing
+ * of the threshold, in either direction, and every period above it
+ * update the zone, so the governors step with the samples instead of a
+ * polling delay. They run from the work item, which coalesces periods
+ * that arrive while it is pending.
+ */
+void simtemp_thermal_push(struct simtemp_device *dev, s32 temp_mC)
+{
+    struct simtemp_thermal *th = &dev->thermal;
+    bool above;
+
+    if (!th->tz)
+        return;
+
+    WRITE_ONCE(th->temp_mC, temp_mC);
+    WRITE_ONCE(th->valid, true);
+
+    above = temp_mC > READ_ONCE(dev->threshold_mC);
+    if (above || above != th->above) {
+        th->above = above;
+        schedule_work(&th->work);
+    }
+}
+
+static int simtemp_thermal_sync_one(struct thermal_trip *trip, void *data)
+{
+    struct simtemp_device *dev = data;
+
+    thermal_zone_set_trip_temp(dev->thermal.tz, trip,
+                               READ_ONCE(dev->threshold_mC));
+    return 0;
+}
+
+/**
+ * simtemp_thermal_sync_trip - Move the trip point to threshold_mC
+ * @dev: Device structure, bound to the driver
+ *
+ * Called by simtemp_set_threshold() after threshold_mC changed outside
+ * the thermal core. The trip takes the current value under the zone
+ * lock, so concurrent writers leave the same last value in both places.
+ * The zone is re-evaluated at once, a crossing need not wait for a
+ * sample.
+ */
+void simtemp_thermal_sync_trip(struct simtemp_device *dev)
+{
+    struct thermal_zone_device *tz = dev->thermal.tz;
+
+    if (!tz)
+        return;
+
+    thermal_zone_for_each_trip(tz, simtemp_thermal_sync_one, dev);
+    thermal_zone_device_update(tz, THERMAL_TRIP_CHANGED);
+}
+
+/**
+ * simtemp_thermal_init - Register the thermal zone of an instance
+ * @dev: Device structure
+ *
+ * The zone starts disabled, enabling it starts generation.
+ *
+ * Returns: 0 on success, negative errno on failure
+ */
+int simtemp_thermal_init(struct simtemp_device *dev)
+{
+    struct simtemp_thermal *th = &dev->thermal;
+    struct thermal_trip trip = {
+        .temperature = dev->threshold_mC,
+        .type = THERMAL_TRIP_PASSIVE,
+        .flags = THERMAL_TRIP_FLAG_RW_TEMP,
+    };
+    struct thermal_zone_device *tz;
+
+    INIT_WORK(&th->work, simtemp_thermal_work);
+
+    /* No polling at all, simtemp_thermal_push() drives the updates */
+    tz = thermal_zone_device_register_with_trips(dev->name, &trip, 1, dev,
+                                                 &simtemp_thermal_ops, NULL,
+                                                 0, 0);
+    if (IS_ERR(tz))
+        return PTR_ERR(tz);
+
+    th->tz = tz;
+    return 0;
+}
+
+/**
+ * simtemp_thermal_exit - Unregister the thermal zone of an instance
+ * @dev: Device structure
+ *
+ * Drops the session of an enabled zone. Called once the device is dead
+ * and generation has stopped for good, so no new work gets queued.
+ */
+void simtemp_thermal_exit(struct simtemp_device *dev)
+{
+    struct simtemp_thermal *th = &dev->thermal;
+    struct thermal_zone_device *tz = th->tz;
+
+    if (!tz)
+        return;
+
+    mutex_lock(&dev->gen_lock);
+    if (th->enabled) {
+        simtemp_session_put(dev);
+        th->enabled = false;
+    }
+    mutex_unlock(&dev->gen_lock);
+
+    cancel_work_sync(&th->work);
+    thermal_zone_device_unregister(tz);
+    th->tz = NULL;
+}
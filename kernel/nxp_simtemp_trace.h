@@ -0,0 +1,165 @@
+/*
+ * nxp_simtemp_trace.h - Tracepoints for the NXP simtemp driver
+ *
+ * Enable with e.g.
+ *   echo 1 > /sys/kernel/tracing/events/nxp_simtemp/enable
+ * or record them with "perf record -e 'nxp_simtemp:*'". Disabled
+ * tracepoints are patched out through static keys.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nxp_simtemp
+
+#if !defined(_NXP_SIMTEMP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NXP_SIMTEMP_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(simtemp_generate,
+
+    TP_PROTO(const char *name, u64 timestamp_ns, s32 temp_mC, u32 flags),
+
+    TP_ARGS(name, timestamp_ns, temp_mC, flags),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u64, timestamp_ns)
+        __field(s32, temp_mC)
+        __field(u32, flags)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name);
+        __entry->timestamp_ns = timestamp_ns;
+        __entry->temp_mC = temp_mC;
+        __entry->flags = flags;
+    ),
+
+    TP_printk("%s ts=%llu temp_mC=%d flags=0x%x",
+              __get_str(name), __entry->timestamp_ns,
+              __entry->temp_mC, __entry->flags)
+);
+
+/* Events that describe the ring position of a single sample */
+DECLARE_EVENT_CLASS(simtemp_ring_class,
+
+    TP_PROTO(const char *name, u64 timestamp_ns, u64 seq, u64 head),
+
+    TP_ARGS(name, timestamp_ns, seq, head),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u64, timestamp_ns)
+        __field(u64, seq)
+        __field(u64, head)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name);
+        __entry->timestamp_ns = timestamp_ns;
+        __entry->seq = seq;
+        __entry->head = head;
+    ),
+
+    TP_printk("%s ts=%llu seq=%llu head=%llu",
+              __get_str(name), __entry->timestamp_ns,
+              __entry->seq, __entry->head)
+);
+
+/* A sample was stored at ring sequence @seq */
+DEFINE_EVENT(simtemp_ring_class, simtemp_enqueue,
+    TP_PROTO(const char *name, u64 timestamp_ns, u64 seq, u64 head),
+    TP_ARGS(name, timestamp_ns, seq, head)
+);
+
+/* The wait queue was woken right after the sample at @seq was stored */
+DEFINE_EVENT(simtemp_ring_class, simtemp_wakeup,
+    TP_PROTO(const char *name, u64 timestamp_ns, u64 seq, u64 head),
+    TP_ARGS(name, timestamp_ns, seq, head)
+);
+
+/* A reader lost @lost samples and resumes at ring sequence @cursor */
+TRACE_EVENT(simtemp_overwrite,
+
+    TP_PROTO(const char *name, u64 timestamp_ns, u64 cursor, u64 lost),
+
+    TP_ARGS(name, timestamp_ns, cursor, lost),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u64, timestamp_ns)
+        __field(u64, cursor)
+        __field(u64, lost)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name);
+        __entry->timestamp_ns = timestamp_ns;
+        __entry->cursor = cursor;
+        __entry->lost = lost;
+    ),
+
+    TP_printk("%s ts=%llu cursor=%llu lost=%llu",
+              __get_str(name), __entry->timestamp_ns, __entry->cursor,
+              __entry->lost)
+);
+
+TRACE_EVENT(simtemp_poll,
+
+    TP_PROTO(const char *name, u64 cursor, u64 head, unsigned int mask),
+
+    TP_ARGS(name, cursor, head, mask),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u64, cursor)
+        __field(u64, head)
+        __field(unsigned int, mask)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name);
+        __entry->cursor = cursor;
+        __entry->head = head;
+        __entry->mask = mask;
+    ),
+
+    TP_printk("%s cursor=%llu head=%llu mask=0x%x",
+              __get_str(name), __entry->cursor, __entry->head,
+              __entry->mask)
+);
+
+TRACE_EVENT(simtemp_read,
+
+    TP_PROTO(const char *name, u64 timestamp_ns, u64 cursor,
+             unsigned int count),
+
+    TP_ARGS(name, timestamp_ns, cursor, count),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u64, timestamp_ns)
+        __field(u64, cursor)
+        __field(unsigned int, count)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name);
+        __entry->timestamp_ns = timestamp_ns;
+        __entry->cursor = cursor;
+        __entry->count = count;
+    ),
+
+    TP_printk("%s ts=%llu cursor=%llu count=%u",
+              __get_str(name), __entry->timestamp_ns, __entry->cursor,
+              __entry->count)
+);
+
+#endif /* _NXP_SIMTEMP_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nxp_simtemp_trace
+#include <trace/define_trace.h>
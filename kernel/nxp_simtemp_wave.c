@@ -0,0 +1,227 @@
+/*
+ * nxp_simtemp_wave.c - Waveform profiles for nxp_simtemp
+ *
+ * Besides uniform noise the generator can follow a periodic signal
+ * shape, with optional noise on top:
+ *
+ *   echo thermal > /sys/class/misc/simtemp/waveform/profile
+ *   echo 60000 > /sys/class/misc/simtemp/waveform/period_ms
+ *   echo 200 > /sys/class/misc/simtemp/waveform/noise_mC
+ *
+ * Every shape is precomputed once as a unit table in Q15 fixed point
+ * and scaled per device to temp_variation_mC. Samples are then looked
+ * up by a direct digital synthesis phase accumulator: one add per
+ * channel and one table load, independent of the sampling rate.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/random.h>
+#include <linux/fixp-arith.h>
+#include <linux/math64.h>
+#include <linux/sysfs.h>
+
+#include "nxp_simtemp.h"
+
+/* Unit shapes, Q15 in [-32767, 32767], one cycle each */
+static s16 simtemp_wave_units[SIMTEMP_PROFILE_NR][SIMTEMP_WAVE_SIZE];
+
+const char * const simtemp_profile_names[SIMTEMP_PROFILE_NR] = {
+    [SIMTEMP_PROFILE_NOISE] = "noise",
+    [SIMTEMP_PROFILE_SINE] = "sine",
+    [SIMTEMP_PROFILE_RAMP] = "ramp",
+    [SIMTEMP_PROFILE_STEP] = "step",
+    [SIMTEMP_PROFILE_WALK] = "walk",
+    [SIMTEMP_PROFILE_THERMAL] = "thermal",
+};
+
+/*
+ * First-order response to a square wave: heat towards the top for half
+ * a cycle, cool towards the bottom for the other half. The time
+ * constant is 1/16 of a cycle, so each half settles within 0.1%.
+ */
+#define SIMTEMP_THERMAL_SHIFT   (SIMTEMP_WAVE_BITS - 4)
+
+static void __init simtemp_wave_init_thermal(s16 *unit)
+{
+    s32 y = -(32767 << 8), target;  /* Q23 for the filter state */
+    unsigned int pass, i;
+
+    /* The first pass only brings the filter into its steady cycle */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < SIMTEMP_WAVE_SIZE; i++) {
+            target = i < SIMTEMP_WAVE_SIZE / 2 ? 32767 << 8 : -(32767 << 8);
+            y += (target - y) >> SIMTEMP_THERMAL_SHIFT;
+            unit[i] = y >> 8;
+        }
+    }
+}
+
+/*
+ * Random walk made periodic: the drift of the whole walk is removed
+ * linearly so the last step leads back to the first, then the result
+ * is normalized to full scale.
+ */
+static void __init simtemp_wave_init_walk(s16 *unit)
+{
+    static s32 walk[SIMTEMP_WAVE_SIZE] __initdata;
+    s32 pos = 0, peak = 1;
+    unsigned int i;
+
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++) {
+        walk[i] = pos;
+        pos += (s32)(get_random_u32() % 2049) - 1024;
+    }
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++) {
+        walk[i] -= (s32)div_s64((s64)pos * i, SIMTEMP_WAVE_SIZE);
+        peak = max(peak, abs(walk[i]));
+    }
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++)
+        unit[i] = div_s64((s64)walk[i] * 32767, peak);
+}
+
+/**
+ * simtemp_wave_init - Precompute the unit tables
+ *
+ * Called once at module load, before any device is probed.
+ */
+void __init simtemp_wave_init(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++) {
+        /* fixp_sin32_rad() is Q31 */
+        simtemp_wave_units[SIMTEMP_PROFILE_SINE][i] =
+            fixp_sin32_rad(i, SIMTEMP_WAVE_SIZE) >> 16;
+        simtemp_wave_units[SIMTEMP_PROFILE_RAMP][i] =
+            -32767 + (s32)(i * 65534 / (SIMTEMP_WAVE_SIZE - 1));
+        simtemp_wave_units[SIMTEMP_PROFILE_STEP][i] =
+            i < SIMTEMP_WAVE_SIZE / 2 ? -32767 : 32767;
+    }
+    simtemp_wave_init_walk(simtemp_wave_units[SIMTEMP_PROFILE_WALK]);
+    simtemp_wave_init_thermal(simtemp_wave_units[SIMTEMP_PROFILE_THERMAL]);
+}
+
+/**
+ * simtemp_wave_update - Rebuild the device table and phase increment
+ * @dev: Device structure
+ *
+ * Must run whenever the profile, its period, the sampling period or
+ * temp_variation_mC change. Entries are replaced one by one while the
+ * generator may be running, so one period can mix old and new scale.
+ * Caller must hold dev->gen_lock.
+ */
+void simtemp_wave_update(struct simtemp_device *dev)
+{
+    struct simtemp_wave *wave = &dev->wave;
+    const s16 *unit = simtemp_wave_units[wave->profile];
+    s64 amplitude = dev->temp_variation_mC;
+    unsigned int i;
+
+    lockdep_assert_held(&dev->gen_lock);
+
+    for (i = 0; i < SIMTEMP_WAVE_SIZE; i++)
+        WRITE_ONCE(wave->table[i], (s32)((unit[i] * amplitude) >> 15));
+
+    /* Phase advance per sampling period, 2^32 is one cycle */
+    WRITE_ONCE(wave->phase_inc,
+               (u32)mul_u64_u64_div_u64(ktime_to_ns(dev->timer_interval),
+                                        1ULL << 32,
+                                        wave->period_ms * 1000000ULL));
+}
+
+/*
+ * sysfs attributes (/sys/class/misc/simtemp/waveform/)
+ */
+
+static ssize_t profile_show(struct device *d, struct device_attribute *attr,
+                            char *buf)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+
+    return sysfs_emit(buf, "%s\n",
+                      simtemp_profile_names[READ_ONCE(dev->wave.profile)]);
+}
+
+static ssize_t profile_store(struct device *d, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    int profile;
+
+    profile = sysfs_match_string(simtemp_profile_names, buf);
+    if (profile < 0)
+        return profile;
+
+    mutex_lock(&dev->gen_lock);
+    WRITE_ONCE(dev->wave.profile, profile);
+    simtemp_wave_update(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return count;
+}
+static DEVICE_ATTR_RW(profile);
+
+static ssize_t period_ms_show(struct device *d, struct device_attribute *attr,
+                              char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->wave.period_ms));
+}
+
+static ssize_t period_ms_store(struct device *d, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct simtemp_device *dev = simtemp_from_sysfs(d);
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (!val)
+        return -EINVAL;
+
+    mutex_lock(&dev->gen_lock);
+    WRITE_ONCE(dev->wave.period_ms, val);
+    simtemp_wave_update(dev);
+    mutex_unlock(&dev->gen_lock);
+
+    return count;
+}
+static DEVICE_ATTR_RW(period_ms);
+
+static ssize_t noise_mC_show(struct device *d, struct device_attribute *attr,
+                             char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(simtemp_from_sysfs(d)->wave.noise_mC));
+}
+
+static ssize_t noise_mC_store(struct device *d, struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret)
+        return ret;
+    /* Same bound as temp_variation_mC */
+    if (val > 1000000)
+        return -EINVAL;
+
+    WRITE_ONCE(simtemp_from_sysfs(d)->wave.noise_mC, val);
+    return count;
+}
+static DEVICE_ATTR_RW(noise_mC);
+
+static struct attribute *simtemp_wave_attrs[] = {
+    &dev_attr_profile.attr,
+    &dev_attr_period_ms.attr,
+    &dev_attr_noise_mC.attr,
+    NULL,
+};
+
+const struct attribute_group simtemp_wave_group = {
+    .name = "waveform",
+    .attrs = simtemp_wave_attrs,
+};
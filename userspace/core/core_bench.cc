@@ -0,0 +1,155 @@
+/*
+ * core_bench.cc - Microbenchmarks of the nxp_simtemp core in user space
+ *
+ * Google Benchmark cases for the ring and the generator arithmetic,
+ * with a locked std::deque as a plain single consumer queue baseline:
+ *
+ *   make -C userspace/core bench
+ *   ./core_bench --benchmark_filter=Ring
+ *
+ * Absolute numbers differ from the kernel (pthread spinlocks, shared
+ * counters), compare runs of the same build against each other.
+ */
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#include "nxp_simtemp_core.h"
+}
+
+namespace {
+
+struct Ring {
+    explicit Ring(u32 size) : storage(size)
+    {
+        ring_buffer_init(&ring, storage.data(), size, &counters);
+    }
+
+    std::vector<simtemp_sample_v2> storage;
+    simtemp_counters counters{};
+    simtemp_ring_buffer ring{};
+};
+
+/* Producer only, @range(0) samples per put */
+void BM_RingPut(benchmark::State &state)
+{
+    Ring r(64);
+    std::vector<simtemp_sample_v2> batch(state.range(0));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ring_buffer_put(&r.ring, batch.data(),
+                                                 batch.size()));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RingPut)->Arg(1)->Arg(16)->Arg(64);
+
+/* One reader keeping up with the producer */
+void BM_RingPutGet(benchmark::State &state)
+{
+    Ring r(64);
+    std::vector<simtemp_sample_v2> batch(state.range(0)), out(state.range(0));
+    u64 cursor = 0, seq, lost;
+
+    for (auto _ : state) {
+        ring_buffer_put(&r.ring, batch.data(), batch.size());
+        benchmark::DoNotOptimize(ring_buffer_get(&r.ring, &cursor, out.data(),
+                                                 out.size(), U64_MAX,
+                                                 &seq, &lost));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RingPutGet)->Arg(1)->Arg(16)->Arg(64);
+
+/* Several independent readers of the same ring */
+void BM_RingBroadcast(benchmark::State &state)
+{
+    Ring r(64);
+    std::vector<simtemp_sample_v2> batch(16), out(16);
+    std::vector<u64> cursors(state.range(0));
+    u64 seq, lost;
+
+    for (auto _ : state) {
+        ring_buffer_put(&r.ring, batch.data(), batch.size());
+        for (u64 &cursor : cursors)
+            benchmark::DoNotOptimize(ring_buffer_get(&r.ring, &cursor,
+                                                     out.data(), out.size(),
+                                                     U64_MAX, &seq, &lost));
+    }
+    state.SetItemsProcessed(state.iterations() * 16 * state.range(0));
+}
+BENCHMARK(BM_RingBroadcast)->Arg(1)->Arg(4)->Arg(16);
+
+/* Baseline: a locked queue that hands every sample to a single consumer */
+void BM_DequePutGet(benchmark::State &state)
+{
+    std::deque<simtemp_sample_v2> queue;
+    std::vector<simtemp_sample_v2> out(state.range(0));
+    simtemp_sample_v2 s{};
+    std::mutex lock;
+
+    for (auto _ : state) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (int64_t i = 0; i < state.range(0); i++)
+                queue.push_back(s);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (int64_t i = 0; i < state.range(0); i++) {
+                out[i] = queue.front();
+                queue.pop_front();
+            }
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DequePutGet)->Arg(1)->Arg(16)->Arg(64);
+
+/* One shard period of noise samples, as simtemp_generate_sample() does */
+void BM_GenerateNoise(benchmark::State &state)
+{
+    std::vector<simtemp_sample_v2> period(state.range(0));
+    u32 rnd = 1;
+
+    for (auto _ : state) {
+        for (auto &s : period) {
+            rnd = rnd * 1664525u + 1013904223u;
+            s.temp_mC = simtemp_core_noise(25000, 5000, rnd);
+            s.flags = simtemp_core_flags(s.temp_mC, 27000, 0);
+        }
+        benchmark::DoNotOptimize(period.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GenerateNoise)->Arg(1)->Arg(256);
+
+/* One shard period of waveform samples, channels spread by phase */
+void BM_GenerateWave(benchmark::State &state)
+{
+    std::vector<simtemp_sample_v2> period(state.range(0));
+    std::vector<s32> table(SIMTEMP_WAVE_SIZE);
+    u32 phase = 0;
+
+    for (u32 i = 0; i < SIMTEMP_WAVE_SIZE; i++)
+        table[i] = (s32)i * 10;
+
+    for (auto _ : state) {
+        for (auto &s : period) {
+            s.temp_mC = 25000 + simtemp_core_wave(table.data(), phase);
+            s.flags = simtemp_core_flags(s.temp_mC, 27000, 0);
+            phase += SIMTEMP_WAVE_SPREAD;
+        }
+        benchmark::DoNotOptimize(period.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GenerateWave)->Arg(1)->Arg(256);
+
+} /* namespace */
+
+BENCHMARK_MAIN();
@@ -0,0 +1,213 @@
+/*
+ * core_test.cc - Property tests of the nxp_simtemp core in user space
+ *
+ * The fixed ring and generator cases live in the KUnit suites
+ * (kernel/nxp_simtemp_test.c). This file covers what is impractical in
+ * the kernel: long randomized runs that check cursor arithmetic against
+ * a model across many ring wraps, and several reader threads hammering
+ * one producer. Seeds are fixed, so failures reproduce:
+ *
+ *   make -C userspace/core test
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "nxp_simtemp_core.h"
+}
+
+namespace {
+
+/* Samples carry their own sequence number, so any copy can be checked */
+void PutSeq(simtemp_ring_buffer *ring, u64 seq, unsigned int n)
+{
+    std::vector<simtemp_sample_v2> s(n);
+
+    for (unsigned int i = 0; i < n; i++) {
+        s[i].timestamp_ns = seq + i;
+        s[i].temp_mC = (s32)(seq + i);
+    }
+    ring_buffer_put(ring, s.data(), n);
+}
+
+class RingProperty : public ::testing::TestWithParam<u32> {
+protected:
+    void SetUp() override
+    {
+        storage_.assign(GetParam(), simtemp_sample_v2{});
+        ring_buffer_init(&ring_, storage_.data(), GetParam(), &counters_);
+    }
+
+    simtemp_ring_buffer ring_{};
+    simtemp_counters counters_{};
+    std::vector<simtemp_sample_v2> storage_;
+};
+
+/*
+ * Random put and get sizes, readers that stall for several wraps: every
+ * reader gets a gap-free, ordered stream, and what it misses is exactly
+ * what the ring dropped before it came back.
+ */
+TEST_P(RingProperty, RandomizedReadersMatchModel)
+{
+    const u32 size = GetParam();
+    std::mt19937_64 rng(0x5eed0000 + size);
+    std::vector<simtemp_sample_v2> out(2 * size);
+    std::vector<u64> cursors(5, 0), delivered(5, 0), lost_sum(5, 0);
+    u64 head = 0, seq, lost;
+
+    for (int step = 0; step < 200000; step++) {
+        unsigned int n = std::uniform_int_distribution<unsigned int>(1, size)(rng);
+
+        PutSeq(&ring_, head, n);
+        head += n;
+        ASSERT_EQ(ring_.head, head);
+        ASSERT_EQ(ring_buffer_oldest(&ring_), head > size ? head - size : 0);
+
+        for (size_t r = 0; r < cursors.size(); r++) {
+            /* Reader r runs on about one step out of 2^r */
+            if (rng() & ((1u << r) - 1))
+                continue;
+
+            unsigned int max = std::uniform_int_distribution<unsigned int>(
+                1, out.size())(rng);
+            u64 before = cursors[r];
+            u64 oldest = ring_buffer_oldest(&ring_);
+            unsigned int got = ring_buffer_get(&ring_, &cursors[r], out.data(),
+                                               max, U64_MAX, &seq, &lost);
+
+            ASSERT_EQ(lost, before < oldest ? oldest - before : 0);
+            ASSERT_EQ(seq, before + lost);
+            ASSERT_EQ(got, std::min<u64>(max, head - seq));
+            for (unsigned int i = 0; i < got; i++)
+                ASSERT_EQ(out[i].timestamp_ns, seq + i);
+            ASSERT_EQ(cursors[r], seq + got);
+
+            delivered[r] += got;
+            lost_sum[r] += lost;
+        }
+    }
+
+    /* Drain: nothing is delivered twice or vanishes unaccounted */
+    for (size_t r = 0; r < cursors.size(); r++) {
+        unsigned int got;
+
+        do {
+            got = ring_buffer_get(&ring_, &cursors[r], out.data(), out.size(),
+                                  U64_MAX, &seq, &lost);
+            delivered[r] += got;
+            lost_sum[r] += lost;
+        } while (got);
+        EXPECT_EQ(delivered[r] + lost_sum[r], head) << "reader " << r;
+        EXPECT_LE(lost_sum[r], counters_.overwritten) << "reader " << r;
+    }
+    EXPECT_EQ(counters_.overwritten, head - size);
+}
+
+/* until_ns cuts a batch exactly before the first later sample */
+TEST_P(RingProperty, RandomizedUntilBound)
+{
+    const u32 size = GetParam();
+    std::mt19937_64 rng(0x0b0d0000 + size);
+    std::vector<simtemp_sample_v2> out(size);
+    u64 head = 0, cursor = 0, seq, lost;
+
+    for (int step = 0; step < 50000; step++) {
+        unsigned int n = std::uniform_int_distribution<unsigned int>(1, size)(rng);
+
+        PutSeq(&ring_, head, n);
+        head += n;
+
+        u64 oldest = ring_buffer_oldest(&ring_);
+        u64 until = std::uniform_int_distribution<u64>(
+            oldest, head + 2)(rng);
+        u64 from = std::max(cursor, oldest);
+        unsigned int got = ring_buffer_get(&ring_, &cursor, out.data(),
+                                           out.size(), until, &seq, &lost);
+        u64 want = until >= from ? std::min<u64>({ head - from, out.size(),
+                                                   until - from + 1 }) : 0;
+
+        ASSERT_EQ(seq, from);
+        ASSERT_EQ(got, want);
+        ASSERT_EQ(cursor, from + got);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Sizes, RingProperty, ::testing::Values(1u, 2u, 8u, 64u));
+
+/*
+ * One producer, several reader threads on their own cursors for a long
+ * run: each stream stays ordered and complete up to counted losses.
+ */
+TEST(RingConcurrent, ManyReadersLongRun)
+{
+    constexpr u64 total = 2000000;
+    constexpr int readers = 4;
+    std::vector<simtemp_sample_v2> storage(64);
+    simtemp_counters counters{};
+    simtemp_ring_buffer ring{};
+    std::atomic<bool> ordered{true};
+    std::atomic<u64> accounted{0};
+    std::vector<std::thread> threads;
+
+    ring_buffer_init(&ring, storage.data(), storage.size(), &counters);
+
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            simtemp_sample_v2 out[16];
+            u64 cursor = 0, seq, lost, sum = 0;
+            bool ok = true;
+
+            while (cursor < total) {
+                unsigned int n = ring_buffer_get(&ring, &cursor, out,
+                                                 1 + r * 5, U64_MAX,
+                                                 &seq, &lost);
+                sum += n + lost;
+                for (unsigned int i = 0; i < n; i++)
+                    ok &= out[i].timestamp_ns == seq + i;
+                if (!n)
+                    std::this_thread::yield();
+            }
+            if (!ok)
+                ordered = false;
+            accounted += sum;
+        });
+    }
+
+    for (u64 seq = 0; seq < total; seq += 3)
+        PutSeq(&ring, seq, std::min<u64>(3, total - seq));
+    for (auto &t : threads)
+        t.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(accounted, readers * total);
+    EXPECT_EQ(counters.overwritten, total - storage.size());
+}
+
+/* Generator arithmetic over random inputs instead of picked values */
+TEST(GeneratorProperty, RandomizedNoiseAndFlags)
+{
+    std::mt19937_64 rng(0x9e4e);
+
+    for (int i = 0; i < 1000000; i++) {
+        s32 center = std::uniform_int_distribution<s32>(-100000, 100000)(rng);
+        u32 spread = std::uniform_int_distribution<u32>(0, 1000000)(rng);
+        s32 threshold = std::uniform_int_distribution<s32>(-200000, 200000)(rng);
+        u32 rnd = (u32)rng();
+        s32 t = simtemp_core_noise(center, spread, rnd);
+
+        ASSERT_GE(t, center - (s32)spread);
+        ASSERT_LE(t, center + (s32)spread);
+        ASSERT_EQ(simtemp_core_flags(t, threshold, 0),
+                  SIMTEMP_FLAG_NEW_SAMPLE |
+                  (t > threshold ? SIMTEMP_FLAG_THRESHOLD_EXCEEDED : 0u));
+    }
+}
+
+} /* namespace */
@@ -0,0 +1,62 @@
+/*
+ * simtemp_user.h - Kernel API shims for the user space core build
+ *
+ * Just enough of the kernel environment for kernel/nxp_simtemp_core.c:
+ * fixed-size types, READ_ONCE(), min_t(), spinlocks on top of pthread
+ * spinlocks, and per-CPU counters as plain structures updated with
+ * relaxed atomics (user space has no CPU-local storage to rely on).
+ */
+
+#ifndef _SIMTEMP_USER_H
+#define _SIMTEMP_USER_H
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define U64_MAX UINT64_MAX
+
+#define __percpu
+
+#define READ_ONCE(x)        (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val)  (*(volatile __typeof__(x) *)&(x) = (val))
+
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define max_t(type, a, b) ((type)(a) > (type)(b) ? (type)(a) : (type)(b))
+
+/* No interrupts to disable, flags only keep the kernel signatures */
+typedef pthread_spinlock_t spinlock_t;
+
+#define spin_lock_init(lock) pthread_spin_init(lock, PTHREAD_PROCESS_PRIVATE)
+
+#define spin_trylock_irqsave(lock, flags) \
+    ((flags) = 0, pthread_spin_trylock(lock) == 0)
+
+#define spin_lock_irqsave(lock, flags)                                  \
+    do {                                                                \
+        (flags) = 0;                                                    \
+        pthread_spin_lock(lock);                                        \
+    } while (0)
+
+#define spin_unlock_irqrestore(lock, flags)                             \
+    do {                                                                \
+        (void)(flags);                                                  \
+        pthread_spin_unlock(lock);                                      \
+    } while (0)
+
+/* A single, shared copy of every "per-CPU" structure */
+#define this_cpu_add(pcp, val) \
+    ((void)__atomic_fetch_add(&(pcp), (val), __ATOMIC_RELAXED))
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+
+#endif /* _SIMTEMP_USER_H */